@@ -0,0 +1,279 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_ASYNCWRITER_H
+#define BACKEDGES_ASYNCWRITER_H
+
+#include "NdjsonStream.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace backedges
+{
+    // Bounded lock free queue after Vyukov: every cell carries a sequence number that says
+    // whether it is free for the producer at that position or filled for the consumer, so a
+    // push or pop is one CAS on its own index. Safe for any number of producers and consumers,
+    // AsyncWriter uses it with one consumer. Capacity has to be a power of two.
+    template <typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t capacity) : cells(capacity), mask(capacity - 1)
+        {
+            assert(capacity != 0 && (capacity & mask) == 0 && "capacity must be a power of two");
+            for (size_t index = 0; index < capacity; index++)
+            {
+                cells[index].sequence.store(index, std::memory_order_relaxed);
+            }
+        }
+
+        BoundedQueue(const BoundedQueue &) = delete;
+        BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+        // value is only moved from when there was room
+        bool tryPush(T &&value)
+        {
+            Cell *cell;
+            size_t position = tail.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                cell = &cells[position & mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0)
+                {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    position = tail.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = std::move(value);
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T &value)
+        {
+            Cell *cell;
+            size_t position = head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                cell = &cells[position & mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+                if (difference == 0)
+                {
+                    if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    position = head.load(std::memory_order_relaxed);
+                }
+            }
+            value = std::move(cell->value);
+            cell->sequence.store(position + mask + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::vector<Cell> cells;
+        const size_t mask;
+        // producers and the consumer each get their own cache line
+        alignas(64) std::atomic<size_t> tail{0};
+        alignas(64) std::atomic<size_t> head{0};
+    };
+
+    // -stats-async: a thread that formats and writes what the passes hand it, so the
+    // analysis never waits on the disk. Per function NDJSON lines go through the queue as
+    // plain records, the end of module files as tasks. Everything is written in the order it
+    // was submitted; flush() is the barrier that waits until it has been.
+    class AsyncWriter
+    {
+    public:
+        static const size_t Capacity = 1 << 14;
+
+        AsyncWriter() : queue(Capacity), worker([this]() { run(); }) {}
+
+        ~AsyncWriter()
+        {
+            flush();
+            stopping.store(true, std::memory_order_release);
+            worker.join();
+        }
+
+        AsyncWriter(const AsyncWriter &) = delete;
+        AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+        // functionName has to stay valid until it is written, the interned names do
+        void record(NdjsonStream &stream, llvm::StringRef functionName, int value)
+        {
+            Item item;
+            item.stream = &stream;
+            item.functionName = functionName;
+            item.value = value;
+            push(std::move(item));
+        }
+
+        void record(NdjsonStream &stream, llvm::StringRef functionName, int value, double domPerBlock)
+        {
+            Item item;
+            item.stream = &stream;
+            item.functionName = functionName;
+            item.value = value;
+            item.hasDomPerBlock = true;
+            item.domPerBlock = domPerBlock;
+            push(std::move(item));
+        }
+
+        void submit(std::function<void()> task)
+        {
+            Item item;
+            item.task = std::move(task);
+            push(std::move(item));
+        }
+
+        // returns once everything submitted before the call has been written
+        void flush()
+        {
+            uint64_t target = submitted.load(std::memory_order_acquire);
+            for (unsigned idle = 0; completed.load(std::memory_order_acquire) < target; idle++)
+            {
+                backoff(idle);
+            }
+        }
+
+        // started on first use, joined when the plugin is unloaded
+        static AsyncWriter &shared()
+        {
+            static AsyncWriter writer;
+            return writer;
+        }
+
+    private:
+        struct Item
+        {
+            NdjsonStream *stream = nullptr;
+            llvm::StringRef functionName;
+            int value = 0;
+            bool hasDomPerBlock = false;
+            double domPerBlock = 0;
+            std::function<void()> task;
+        };
+
+        BoundedQueue<Item> queue;
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<bool> stopping{false};
+        std::thread worker;
+
+        // a full queue makes the pass wait for the writer, memory stays bounded
+        void push(Item &&item)
+        {
+            submitted.fetch_add(1, std::memory_order_acq_rel);
+            for (unsigned idle = 0; !queue.tryPush(std::move(item)); idle++)
+            {
+                backoff(idle);
+            }
+        }
+
+        void run()
+        {
+            Item item;
+            unsigned idle = 0;
+            for (;;)
+            {
+                if (queue.tryPop(item))
+                {
+                    write(item);
+                    item = Item();
+                    completed.fetch_add(1, std::memory_order_release);
+                    idle = 0;
+                    continue;
+                }
+                // only stop on an empty queue, the destructor flushed before asking
+                if (stopping.load(std::memory_order_acquire))
+                {
+                    return;
+                }
+                backoff(idle++);
+            }
+        }
+
+        static void write(Item &item)
+        {
+            if (item.task)
+            {
+                item.task();
+            }
+            else if (item.hasDomPerBlock)
+            {
+                item.stream->record(item.functionName, item.value, item.domPerBlock);
+            }
+            else
+            {
+                item.stream->record(item.functionName, item.value);
+            }
+        }
+
+        // spin a little, then give the core away, then sleep
+        static void backoff(unsigned idle)
+        {
+            if (idle < 64)
+            {
+                return;
+            }
+            if (idle < 128)
+            {
+                std::this_thread::yield();
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    };
+}
+
+#endif // BACKEDGES_ASYNCWRITER_H
@@ -0,0 +1,211 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_CFGINDEX_H
+#define BACKEDGES_CFGINDEX_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+
+#include <utility>
+#include <vector>
+
+namespace backedges
+{
+    // marks an unreachable node or a missing parent/idom in the index based structures
+    const unsigned NoNode = ~0u;
+
+    // Compressed sparse row view of a CFG. Nodes are dense indices and node 0 is the entry.
+    // Successor and predecessor lists keep duplicate edges (a switch with two cases to the
+    // same block) so edge counts match what getNumSuccessors() reports.
+    struct CSRGraph
+    {
+        unsigned numNodes = 0;
+        std::vector<unsigned> succOffsets;
+        std::vector<unsigned> succs;
+        std::vector<unsigned> predOffsets;
+        std::vector<unsigned> preds;
+
+        llvm::ArrayRef<unsigned> successors(unsigned node) const
+        {
+            return llvm::ArrayRef<unsigned>(succs.data() + succOffsets[node],
+                                            succOffsets[node + 1] - succOffsets[node]);
+        }
+
+        llvm::ArrayRef<unsigned> predecessors(unsigned node) const
+        {
+            return llvm::ArrayRef<unsigned>(preds.data() + predOffsets[node],
+                                            predOffsets[node + 1] - predOffsets[node]);
+        }
+
+        unsigned numEdges() const
+        {
+            return succs.size();
+        }
+
+        // builds a graph from plain adjacency lists, used by the benchmarks to describe shapes
+        static CSRGraph fromAdjacency(const std::vector<std::vector<unsigned>> &adjacency)
+        {
+            CSRGraph graph;
+            graph.numNodes = adjacency.size();
+            graph.succOffsets.reserve(graph.numNodes + 1);
+            graph.succOffsets.push_back(0);
+            for (const std::vector<unsigned> &succList : adjacency)
+            {
+                graph.succs.insert(graph.succs.end(), succList.begin(), succList.end());
+                graph.succOffsets.push_back(graph.succs.size());
+            }
+            graph.buildPredecessors();
+            return graph;
+        }
+
+        // counting sort of the successor lists into predecessor lists
+        void buildPredecessors()
+        {
+            predOffsets.assign(numNodes + 1, 0);
+            for (unsigned succ : succs)
+            {
+                predOffsets[succ + 1]++;
+            }
+            for (unsigned i = 0; i < numNodes; i++)
+            {
+                predOffsets[i + 1] += predOffsets[i];
+            }
+            preds.resize(succs.size());
+            std::vector<unsigned> fill(predOffsets.begin(), predOffsets.end() - 1);
+            for (unsigned u = 0; u < numNodes; u++)
+            {
+                for (unsigned v : successors(u))
+                {
+                    preds[fill[v]++] = u;
+                }
+            }
+        }
+
+        size_t memoryFootprint() const
+        {
+            return sizeof(unsigned) * (succOffsets.capacity() + succs.capacity() +
+                                       predOffsets.capacity() + preds.capacity());
+        }
+    };
+
+    // Numbers the blocks of a function in layout order (the entry block is always 0)
+    // and records the CFG once so the analyses below can work on plain indices.
+    struct IndexedCFG
+    {
+        const llvm::Function *func = nullptr;
+        std::vector<const llvm::BasicBlock *> blocks;
+        llvm::DenseMap<const llvm::BasicBlock *, unsigned> index;
+        CSRGraph graph;
+
+        explicit IndexedCFG(const llvm::Function &F) : func(&F)
+        {
+            blocks.reserve(F.size());
+            index.reserve(F.size());
+            for (const llvm::BasicBlock &block : F)
+            {
+                index[&block] = blocks.size();
+                blocks.push_back(&block);
+            }
+
+            graph.numNodes = blocks.size();
+            graph.succOffsets.reserve(graph.numNodes + 1);
+            graph.succOffsets.push_back(0);
+            for (const llvm::BasicBlock *block : blocks)
+            {
+                for (const llvm::BasicBlock *succ : llvm::successors(block))
+                {
+                    graph.succs.push_back(index.lookup(succ));
+                }
+                graph.succOffsets.push_back(graph.succs.size());
+            }
+            graph.buildPredecessors();
+        }
+
+        unsigned size() const
+        {
+            return blocks.size();
+        }
+
+        unsigned indexOf(const llvm::BasicBlock *block) const
+        {
+            return index.lookup(block);
+        }
+    };
+
+    // Iterative depth first numbering from the entry node. Recursion is avoided on purpose,
+    // generated code can have CFGs deep enough to overflow the stack.
+    struct DFSNumbering
+    {
+        std::vector<unsigned> preNum;   // node -> preorder number, NoNode if unreachable
+        std::vector<unsigned> postNum;  // node -> postorder number, NoNode if unreachable
+        std::vector<unsigned> parent;   // node -> DFS tree parent, NoNode for the entry
+        std::vector<unsigned> preorder; // preorder number -> node
+        std::vector<unsigned> postorder;// postorder number -> node
+
+        explicit DFSNumbering(const CSRGraph &graph)
+            : preNum(graph.numNodes, NoNode), postNum(graph.numNodes, NoNode), parent(graph.numNodes, NoNode)
+        {
+            if (graph.numNodes == 0)
+            {
+                return;
+            }
+            preorder.reserve(graph.numNodes);
+            postorder.reserve(graph.numNodes);
+            std::vector<std::pair<unsigned, unsigned>> stack;
+            preNum[0] = 0;
+            preorder.push_back(0);
+            stack.push_back(std::make_pair(0u, 0u));
+            while (!stack.empty())
+            {
+                unsigned node = stack.back().first;
+                llvm::ArrayRef<unsigned> succList = graph.successors(node);
+                if (stack.back().second < succList.size())
+                {
+                    unsigned succ = succList[stack.back().second++];
+                    if (preNum[succ] == NoNode)
+                    {
+                        preNum[succ] = preorder.size();
+                        preorder.push_back(succ);
+                        parent[succ] = node;
+                        stack.push_back(std::make_pair(succ, 0u));
+                    }
+                }
+                else
+                {
+                    postNum[node] = postorder.size();
+                    postorder.push_back(node);
+                    stack.pop_back();
+                }
+            }
+        }
+
+        bool isReachable(unsigned node) const
+        {
+            return preNum[node] != NoNode;
+        }
+
+        // u is an ancestor of (or equal to) v in the DFS spanning tree
+        bool isAncestor(unsigned u, unsigned v) const
+        {
+            return preNum[u] <= preNum[v] && postNum[v] <= postNum[u];
+        }
+    };
+}
+
+#endif // BACKEDGES_CFGINDEX_H
@@ -0,0 +1,82 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_CACHELINEARRAY_H
+#define BACKEDGES_CACHELINEARRAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace backedges
+{
+    const size_t CacheLineSize = 64;
+
+    // A fixed number of default constructed T, each starting on a cache line of its own, so
+    // threads working on neighbouring elements never share a line. new[] only honours the
+    // default alignment before C++17, so the storage is aligned and strided by hand.
+    template <typename T>
+    class CacheLineArray
+    {
+    public:
+        explicit CacheLineArray(size_t count) : count(count)
+        {
+            storage = static_cast<char *>(::operator new(count * Stride + CacheLineSize - 1));
+            uintptr_t address = reinterpret_cast<uintptr_t>(storage);
+            first = storage + (CacheLineSize - address % CacheLineSize) % CacheLineSize;
+            for (size_t index = 0; index < count; index++)
+            {
+                new (first + index * Stride) T();
+            }
+        }
+
+        ~CacheLineArray()
+        {
+            for (size_t index = 0; index < count; index++)
+            {
+                (*this)[index].~T();
+            }
+            ::operator delete(storage);
+        }
+
+        CacheLineArray(const CacheLineArray &) = delete;
+        CacheLineArray &operator=(const CacheLineArray &) = delete;
+
+        T &operator[](size_t index)
+        {
+            return *reinterpret_cast<T *>(first + index * Stride);
+        }
+
+        const T &operator[](size_t index) const
+        {
+            return *reinterpret_cast<const T *>(first + index * Stride);
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+
+    private:
+        // sizeof(T) rounded up to whole cache lines
+        static const size_t Stride = (sizeof(T) + CacheLineSize - 1) / CacheLineSize * CacheLineSize;
+
+        size_t count;
+        char *storage;
+        char *first;
+    };
+}
+
+#endif // BACKEDGES_CACHELINEARRAY_H
@@ -0,0 +1,437 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_COLUMNARSTATS_H
+#define BACKEDGES_COLUMNARSTATS_H
+
+#include "NameTable.h"
+#include "StatsAccumulator.h"
+#include "StatsShard.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// testResults/<CountName>.stats.bin, everything little endian:
+//
+//   header           64 bytes, see ColumnarHeader
+//   column directory 64 bytes per column, see ColumnarColumn
+//   name offsets     (NameCount + 1) x uint64, name i is blob[offset[i], offset[i + 1])
+//   name blob        the function names back to back, no terminators
+//   columns          Rows values each, every column starts on a 64 byte boundary
+//
+// Column 0 is "functionName", ids into the name table, column 1 the pass's count, the
+// dominator passes add "DomPerBlock". The name table is the plugin's interned table, so
+// reading a file back costs one mmap and no parsing.
+namespace backedges
+{
+    const char ColumnarMagic[8] = {'B', 'E', 'S', 'T', 'A', 'T', 'S', '\0'};
+    const uint32_t ColumnarVersion = 1;
+    const uint64_t ColumnarAlignment = 64;
+
+    enum class ColumnType : uint32_t
+    {
+        NameId = 1,
+        Int32 = 2,
+        Float64 = 3
+    };
+
+    // how the summary was reported, so the converter writes the same JSON back
+    enum ColumnarFlags : uint32_t
+    {
+        ReportsSummation = 1u << 0,
+        ReportsMinimum = 1u << 1,
+        ReportsAverage = 1u << 2,
+        ReportsExtended = 1u << 3,
+        ReportsSketch = 1u << 4,
+        ReportsTier = 1u << 5
+    };
+
+    struct ColumnarHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t rows;
+        uint32_t columnCount;
+        uint32_t nameCount;
+        uint64_t namesOffset;
+        uint64_t columnsOffset;
+        uint32_t topK;
+        uint32_t reserved;
+        int64_t irreducibleFunctions;
+    };
+
+    struct ColumnarColumn
+    {
+        char name[48];
+        uint32_t type;
+        uint32_t width;
+        uint64_t offset;
+    };
+
+    static_assert(sizeof(ColumnarHeader) == 64, "the header layout is part of the format");
+    static_assert(sizeof(ColumnarColumn) == 64, "the directory layout is part of the format");
+
+    template <typename T> struct ColumnTypeOf;
+    template <> struct ColumnTypeOf<uint32_t> { static const ColumnType value = ColumnType::NameId; };
+    template <> struct ColumnTypeOf<int32_t> { static const ColumnType value = ColumnType::Int32; };
+    template <> struct ColumnTypeOf<double> { static const ColumnType value = ColumnType::Float64; };
+
+    namespace detail
+    {
+        // little endian writes that know where in the file they are, for the padding
+        class ColumnarWriter
+        {
+        public:
+            explicit ColumnarWriter(llvm::raw_ostream &os) : os(os), out(os, llvm::support::little) {}
+
+            template <typename T>
+            void write(T value)
+            {
+                out.write<T>(value);
+                position += sizeof(T);
+            }
+
+            void writeBytes(llvm::StringRef bytes)
+            {
+                os << bytes;
+                position += bytes.size();
+            }
+
+            // a fixed size, zero padded name
+            void writeName(llvm::StringRef name, size_t size)
+            {
+                name = name.take_front(size - 1);
+                writeBytes(name);
+                padTo(position + size - name.size());
+            }
+
+            void padTo(uint64_t offset)
+            {
+                os.write_zeros(offset - position);
+                position = offset;
+            }
+
+            uint64_t tell() const
+            {
+                return position;
+            }
+
+        private:
+            llvm::raw_ostream &os;
+            llvm::support::endian::Writer out;
+            uint64_t position = 0;
+        };
+    }
+
+    // metric carries the reporting options, series and byBlock the per function values, so
+    // both have to have kept them
+    inline void writeColumnarStats(llvm::raw_ostream &os, const ShardMetric &metric, const MetricSeries<int> &series,
+                                   const MetricSeries<double> *byBlock, const NameTable &names)
+    {
+        uint64_t rows = series.records.size();
+        // the table can grow while this runs on the async writer, the file gets the names up to now
+        uint32_t nameCount = names.size();
+        uint32_t columnCount = byBlock != nullptr ? 3 : 2;
+        uint64_t namesOffset = sizeof(ColumnarHeader) + columnCount * sizeof(ColumnarColumn);
+        uint64_t blobOffset = namesOffset + (nameCount + 1) * sizeof(uint64_t);
+        uint64_t blobSize = 0;
+        for (uint32_t id = 0; id < nameCount; id++)
+        {
+            blobSize += names.name(id).size();
+        }
+        uint64_t columnOffsets[3];
+        uint64_t columnWidths[3] = {sizeof(uint32_t), sizeof(int32_t), sizeof(double)};
+        uint64_t next = llvm::alignTo(blobOffset + blobSize, ColumnarAlignment);
+        for (uint32_t column = 0; column < columnCount; column++)
+        {
+            columnOffsets[column] = next;
+            next = llvm::alignTo(next + rows * columnWidths[column], ColumnarAlignment);
+        }
+
+        uint32_t flags = 0;
+        flags |= metric.hasSummation ? static_cast<uint32_t>(ReportsSummation) : 0;
+        flags |= metric.hasMinimum ? static_cast<uint32_t>(ReportsMinimum) : 0;
+        flags |= metric.hasAverage ? static_cast<uint32_t>(ReportsAverage) : 0;
+        flags |= metric.extended ? static_cast<uint32_t>(ReportsExtended) : 0;
+        flags |= metric.sketch.isEnabled() ? static_cast<uint32_t>(ReportsSketch) : 0;
+        flags |= metric.hasTier ? static_cast<uint32_t>(ReportsTier) : 0;
+
+        detail::ColumnarWriter out(os);
+        out.writeBytes(llvm::StringRef(ColumnarMagic, sizeof(ColumnarMagic)));
+        out.write<uint32_t>(ColumnarVersion);
+        out.write<uint32_t>(flags);
+        out.write<uint64_t>(rows);
+        out.write<uint32_t>(columnCount);
+        out.write<uint32_t>(nameCount);
+        out.write<uint64_t>(namesOffset);
+        out.write<uint64_t>(sizeof(ColumnarHeader));
+        out.write<uint32_t>(series.top.getLimit());
+        out.write<uint32_t>(0);
+        out.write<int64_t>(metric.irreducibleFunctions);
+
+        const char *columnNames[3] = {"functionName", metric.countName.c_str(), "DomPerBlock"};
+        const ColumnType columnTypes[3] = {ColumnType::NameId, ColumnType::Int32, ColumnType::Float64};
+        for (uint32_t column = 0; column < columnCount; column++)
+        {
+            out.writeName(columnNames[column], sizeof(ColumnarColumn::name));
+            out.write<uint32_t>(static_cast<uint32_t>(columnTypes[column]));
+            out.write<uint32_t>(columnWidths[column]);
+            out.write<uint64_t>(columnOffsets[column]);
+        }
+
+        uint64_t offset = 0;
+        for (uint32_t id = 0; id < nameCount; id++)
+        {
+            out.write<uint64_t>(offset);
+            offset += names.name(id).size();
+        }
+        out.write<uint64_t>(offset);
+        for (uint32_t id = 0; id < nameCount; id++)
+        {
+            out.writeBytes(names.name(id));
+        }
+
+        out.padTo(columnOffsets[0]);
+        for (const FunctionRecord<int> &record : series.records)
+        {
+            out.write<uint32_t>(record.nameId);
+        }
+        out.padTo(columnOffsets[1]);
+        for (const FunctionRecord<int> &record : series.records)
+        {
+            out.write<int32_t>(record.value);
+        }
+        if (byBlock != nullptr)
+        {
+            out.padTo(columnOffsets[2]);
+            for (const FunctionRecord<double> &record : byBlock->records)
+            {
+                out.write<double>(record.value);
+            }
+        }
+        out.padTo(next);
+    }
+
+    // A .stats.bin mapped read only. Every accessor hands out pointers into the mapping, so
+    // the file has to outlive what it returns. Only little endian hosts can read it in place.
+    class ColumnarStatsFile
+    {
+    public:
+        static std::unique_ptr<ColumnarStatsFile> open(const llvm::Twine &path, std::string &error)
+        {
+            if (!llvm::sys::IsLittleEndianHost)
+            {
+                error = "columnar stats are only read on little endian hosts";
+                return nullptr;
+            }
+            uint64_t size;
+            int fd;
+            if (llvm::sys::fs::file_size(path, size) || llvm::sys::fs::openFileForRead(path, fd))
+            {
+                error = "cannot open " + path.str();
+                return nullptr;
+            }
+            if (size < sizeof(ColumnarHeader))
+            {
+                llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+                error = "too short for a header";
+                return nullptr;
+            }
+            std::error_code EC;
+            std::unique_ptr<ColumnarStatsFile> file(new ColumnarStatsFile());
+            file->region.reset(new llvm::sys::fs::mapped_file_region(fd, llvm::sys::fs::mapped_file_region::readonly,
+                                                                     size, 0, EC));
+            llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+            if (EC)
+            {
+                error = "cannot map " + path.str() + ": " + EC.message();
+                return nullptr;
+            }
+            if (!file->validate(error))
+            {
+                return nullptr;
+            }
+            return file;
+        }
+
+        uint64_t rows() const
+        {
+            return header().rows;
+        }
+
+        bool reports(ColumnarFlags flag) const
+        {
+            return (header().flags & flag) != 0;
+        }
+
+        unsigned topK() const
+        {
+            return header().topK;
+        }
+
+        int64_t irreducibleFunctions() const
+        {
+            return header().irreducibleFunctions;
+        }
+
+        llvm::StringRef countName() const
+        {
+            return columnName(1);
+        }
+
+        unsigned nameCount() const
+        {
+            return header().nameCount;
+        }
+
+        llvm::StringRef name(uint32_t id) const
+        {
+            const uint64_t *offsets = nameOffsets();
+            const char *blob = reinterpret_cast<const char *>(offsets + nameCount() + 1);
+            return llvm::StringRef(blob + offsets[id], offsets[id + 1] - offsets[id]);
+        }
+
+        llvm::ArrayRef<uint32_t> functionNames() const
+        {
+            return column<uint32_t>("functionName");
+        }
+
+        // empty if the file has no such column or it holds another type
+        template <typename T>
+        llvm::ArrayRef<T> column(llvm::StringRef name) const
+        {
+            for (uint32_t index = 0; index < header().columnCount; index++)
+            {
+                const ColumnarColumn &entry = columns()[index];
+                if (columnName(index) == name && entry.type == static_cast<uint32_t>(ColumnTypeOf<T>::value))
+                {
+                    return llvm::ArrayRef<T>(reinterpret_cast<const T *>(data() + entry.offset), rows());
+                }
+            }
+            return llvm::ArrayRef<T>();
+        }
+
+    private:
+        std::unique_ptr<llvm::sys::fs::mapped_file_region> region;
+
+        ColumnarStatsFile() = default;
+
+        const char *data() const
+        {
+            return region->const_data();
+        }
+
+        const ColumnarHeader &header() const
+        {
+            return *reinterpret_cast<const ColumnarHeader *>(data());
+        }
+
+        const ColumnarColumn *columns() const
+        {
+            return reinterpret_cast<const ColumnarColumn *>(data() + header().columnsOffset);
+        }
+
+        const uint64_t *nameOffsets() const
+        {
+            return reinterpret_cast<const uint64_t *>(data() + header().namesOffset);
+        }
+
+        llvm::StringRef columnName(uint32_t index) const
+        {
+            const char *name = columns()[index].name;
+            return llvm::StringRef(name, strnlen(name, sizeof(ColumnarColumn::name)));
+        }
+
+        // everything the accessors index is checked once here, so they do not have to
+        bool validate(std::string &error) const
+        {
+            uint64_t size = region->size();
+            const ColumnarHeader &head = header();
+            if (std::memcmp(head.magic, ColumnarMagic, sizeof(ColumnarMagic)) != 0 || head.version != ColumnarVersion)
+            {
+                error = "not a version " + std::to_string(ColumnarVersion) + " columnar stats file";
+                return false;
+            }
+            if (head.columnsOffset % alignof(ColumnarColumn) != 0 || head.columnCount < 2 ||
+                head.columnsOffset > size || head.columnCount > (size - head.columnsOffset) / sizeof(ColumnarColumn))
+            {
+                error = "bad column directory";
+                return false;
+            }
+            if (head.namesOffset % alignof(uint64_t) != 0 || head.namesOffset > size ||
+                head.nameCount >= (size - head.namesOffset) / sizeof(uint64_t))
+            {
+                error = "bad name table";
+                return false;
+            }
+            const uint64_t *offsets = nameOffsets();
+            uint64_t blobSize = size - (head.namesOffset + (head.nameCount + 1) * sizeof(uint64_t));
+            for (uint32_t id = 0; id < head.nameCount; id++)
+            {
+                if (offsets[id] > offsets[id + 1])
+                {
+                    error = "bad name table";
+                    return false;
+                }
+            }
+            if (offsets[0] != 0 || offsets[head.nameCount] > blobSize)
+            {
+                error = "bad name table";
+                return false;
+            }
+            for (uint32_t index = 0; index < head.columnCount; index++)
+            {
+                const ColumnarColumn &entry = columns()[index];
+                uint64_t width = entry.type == static_cast<uint32_t>(ColumnType::Float64) ? 8 : 4;
+                if (entry.width != width || entry.offset % width != 0 || entry.offset > size ||
+                    head.rows > (size - entry.offset) / width)
+                {
+                    error = "bad column " + columnName(index).str();
+                    return false;
+                }
+            }
+            if (functionNames().size() != head.rows || column<int32_t>(countName()).size() != head.rows)
+            {
+                error = "missing functionName or count column";
+                return false;
+            }
+            for (uint32_t id : functionNames())
+            {
+                if (id >= head.nameCount)
+                {
+                    error = "function name id out of range";
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}
+
+#endif // BACKEDGES_COLUMNARSTATS_H
@@ -0,0 +1,358 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_DOMINATORENGINES_H
+#define BACKEDGES_DOMINATORENGINES_H
+
+#include "CFGIndex.h"
+
+#include "llvm/IR/Dominators.h"
+
+#include <vector>
+
+namespace backedges
+{
+    enum class DomEngineKind
+    {
+        CooperHarveyKennedy,
+        LengauerTarjan,
+        SemiNCA
+    };
+
+    inline const char *domEngineName(DomEngineKind kind)
+    {
+        switch (kind)
+        {
+            case DomEngineKind::CooperHarveyKennedy:
+                return "chk";
+            case DomEngineKind::LengauerTarjan:
+                return "lt";
+            case DomEngineKind::SemiNCA:
+                return "snca";
+        }
+        return "unknown";
+    }
+
+    // The tree every engine produces. Queries follow DominatorTree semantics for blocks:
+    // a block dominates itself, an unreachable block is dominated by every block and
+    // dominates nothing but itself, properlyDominates is dominates minus the block itself.
+    struct DomTreeView
+    {
+        std::vector<unsigned> idom;  // node -> immediate dominator, NoNode for the entry and unreachable nodes
+        std::vector<unsigned> depth; // node -> depth in the dominator tree, the entry is 0
+        std::vector<unsigned> dfsIn; // node -> interval in a DFS over the dominator tree, NoNode if unreachable
+        std::vector<unsigned> dfsOut;
+
+        unsigned size() const
+        {
+            return idom.size();
+        }
+
+        bool isReachable(unsigned node) const
+        {
+            return dfsIn[node] != NoNode;
+        }
+
+        bool dominates(unsigned a, unsigned b) const
+        {
+            if (a == b || !isReachable(b))
+            {
+                return true;
+            }
+            if (!isReachable(a))
+            {
+                return false;
+            }
+            return dfsIn[a] <= dfsIn[b] && dfsOut[b] <= dfsOut[a];
+        }
+
+        bool properlyDominates(unsigned a, unsigned b) const
+        {
+            return a != b && dominates(a, b);
+        }
+
+        // number of blocks a with dominates(a, node), what the O(n^2) pair loop used to count
+        unsigned numDominators(unsigned node) const
+        {
+            return isReachable(node) ? depth[node] + 1 : size();
+        }
+
+        // number of blocks a with properlyDominates(a, node)
+        unsigned numProperDominators(unsigned node) const
+        {
+            return isReachable(node) ? depth[node] : size() - 1;
+        }
+
+        // fills depth and the DFS intervals once idom is known
+        void finalize()
+        {
+            const unsigned n = idom.size();
+            depth.assign(n, 0);
+            dfsIn.assign(n, NoNode);
+            dfsOut.assign(n, NoNode);
+            if (n == 0)
+            {
+                return;
+            }
+
+            std::vector<unsigned> childOffsets(n + 1, 0);
+            for (unsigned node = 0; node < n; node++)
+            {
+                if (idom[node] != NoNode)
+                {
+                    childOffsets[idom[node] + 1]++;
+                }
+            }
+            for (unsigned node = 0; node < n; node++)
+            {
+                childOffsets[node + 1] += childOffsets[node];
+            }
+            std::vector<unsigned> children(childOffsets[n]);
+            std::vector<unsigned> fill(childOffsets.begin(), childOffsets.end() - 1);
+            for (unsigned node = 0; node < n; node++)
+            {
+                if (idom[node] != NoNode)
+                {
+                    children[fill[idom[node]]++] = node;
+                }
+            }
+
+            unsigned counter = 0;
+            std::vector<std::pair<unsigned, unsigned>> stack;
+            dfsIn[0] = counter++;
+            stack.push_back(std::make_pair(0u, childOffsets[0]));
+            while (!stack.empty())
+            {
+                unsigned node = stack.back().first;
+                if (stack.back().second < childOffsets[node + 1])
+                {
+                    unsigned child = children[stack.back().second++];
+                    depth[child] = depth[node] + 1;
+                    dfsIn[child] = counter++;
+                    stack.push_back(std::make_pair(child, childOffsets[child]));
+                }
+                else
+                {
+                    dfsOut[node] = counter++;
+                    stack.pop_back();
+                }
+            }
+        }
+    };
+
+    // Cooper, Harvey, Kennedy "A Simple, Fast Dominance Algorithm": iterate over reverse
+    // postorder intersecting the idoms of processed predecessors until nothing changes.
+    inline DomTreeView buildDominatorsCHK(const CSRGraph &graph)
+    {
+        DomTreeView view;
+        view.idom.assign(graph.numNodes, NoNode);
+        if (graph.numNodes == 0)
+        {
+            return view;
+        }
+
+        DFSNumbering dfs(graph);
+        const unsigned reachableCount = dfs.postorder.size();
+        // idoms are kept as postorder numbers so intersect only compares integers
+        std::vector<unsigned> doms(reachableCount, NoNode);
+        const unsigned entryPost = reachableCount - 1;
+        doms[entryPost] = entryPost;
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            // reverse postorder, skipping the entry
+            for (unsigned post = entryPost; post-- > 0;)
+            {
+                unsigned node = dfs.postorder[post];
+                unsigned newIdom = NoNode;
+                for (unsigned pred : graph.predecessors(node))
+                {
+                    unsigned predPost = dfs.postNum[pred];
+                    if (predPost == NoNode || doms[predPost] == NoNode)
+                    {
+                        continue;
+                    }
+                    if (newIdom == NoNode)
+                    {
+                        newIdom = predPost;
+                        continue;
+                    }
+                    unsigned finger1 = predPost;
+                    unsigned finger2 = newIdom;
+                    while (finger1 != finger2)
+                    {
+                        while (finger1 < finger2)
+                        {
+                            finger1 = doms[finger1];
+                        }
+                        while (finger2 < finger1)
+                        {
+                            finger2 = doms[finger2];
+                        }
+                    }
+                    newIdom = finger1;
+                }
+                if (doms[post] != newIdom)
+                {
+                    doms[post] = newIdom;
+                    changed = true;
+                }
+            }
+        }
+
+        for (unsigned post = 0; post < entryPost; post++)
+        {
+            view.idom[dfs.postorder[post]] = dfs.postorder[doms[post]];
+        }
+        view.finalize();
+        return view;
+    }
+
+    // Lengauer, Tarjan "A Fast Algorithm for Finding Dominators in a Flowgraph",
+    // the simple version with path compression. Everything below works on preorder numbers.
+    inline DomTreeView buildDominatorsLT(const CSRGraph &graph)
+    {
+        DomTreeView view;
+        view.idom.assign(graph.numNodes, NoNode);
+        if (graph.numNodes == 0)
+        {
+            return view;
+        }
+
+        DFSNumbering dfs(graph);
+        const unsigned reachableCount = dfs.preorder.size();
+        std::vector<unsigned> semi(reachableCount);
+        std::vector<unsigned> label(reachableCount);
+        std::vector<unsigned> ancestor(reachableCount, NoNode);
+        std::vector<unsigned> idom(reachableCount, NoNode);
+        std::vector<unsigned> parent(reachableCount, NoNode);
+        // bucket[v] is an intrusive list threaded through bucketNext
+        std::vector<unsigned> bucketHead(reachableCount, NoNode);
+        std::vector<unsigned> bucketNext(reachableCount, NoNode);
+        std::vector<unsigned> path;
+
+        for (unsigned num = 0; num < reachableCount; num++)
+        {
+            semi[num] = num;
+            label[num] = num;
+            unsigned parentNode = dfs.parent[dfs.preorder[num]];
+            parent[num] = parentNode == NoNode ? NoNode : dfs.preNum[parentNode];
+        }
+
+        auto eval = [&](unsigned v) -> unsigned
+        {
+            if (ancestor[v] == NoNode)
+            {
+                return v;
+            }
+            // compress the ancestor chain iteratively
+            path.clear();
+            for (unsigned x = v; ancestor[ancestor[x]] != NoNode; x = ancestor[x])
+            {
+                path.push_back(x);
+            }
+            for (auto iter = path.rbegin(); iter != path.rend(); ++iter)
+            {
+                unsigned x = *iter;
+                if (semi[label[ancestor[x]]] < semi[label[x]])
+                {
+                    label[x] = label[ancestor[x]];
+                }
+                ancestor[x] = ancestor[ancestor[x]];
+            }
+            return label[v];
+        };
+
+        for (unsigned w = reachableCount; w-- > 1;)
+        {
+            for (unsigned predNode : graph.predecessors(dfs.preorder[w]))
+            {
+                unsigned v = dfs.preNum[predNode];
+                if (v == NoNode)
+                {
+                    continue;
+                }
+                unsigned u = eval(v);
+                if (semi[u] < semi[w])
+                {
+                    semi[w] = semi[u];
+                }
+            }
+            bucketNext[w] = bucketHead[semi[w]];
+            bucketHead[semi[w]] = w;
+            ancestor[w] = parent[w];
+
+            unsigned p = parent[w];
+            for (unsigned v = bucketHead[p]; v != NoNode; v = bucketNext[v])
+            {
+                unsigned u = eval(v);
+                idom[v] = semi[u] < semi[v] ? u : p;
+            }
+            bucketHead[p] = NoNode;
+        }
+
+        for (unsigned w = 1; w < reachableCount; w++)
+        {
+            if (idom[w] != semi[w])
+            {
+                idom[w] = idom[idom[w]];
+            }
+            view.idom[dfs.preorder[w]] = dfs.preorder[idom[w]];
+        }
+        view.finalize();
+        return view;
+    }
+
+    // LLVM's own tree (Semi-NCA since LLVM 5) converted to the common view
+    inline DomTreeView dominatorsFromLLVM(const llvm::DominatorTree &domTree, const IndexedCFG &cfg)
+    {
+        DomTreeView view;
+        view.idom.assign(cfg.size(), NoNode);
+        for (unsigned node = 0; node < cfg.size(); node++)
+        {
+            const llvm::DomTreeNode *treeNode = domTree.getNode(const_cast<llvm::BasicBlock *>(cfg.blocks[node]));
+            if (treeNode != nullptr && treeNode->getIDom() != nullptr)
+            {
+                view.idom[node] = cfg.indexOf(treeNode->getIDom()->getBlock());
+            }
+        }
+        view.finalize();
+        return view;
+    }
+
+    inline DomTreeView buildDominatorsSemiNCA(const IndexedCFG &cfg)
+    {
+        llvm::DominatorTree domTree(const_cast<llvm::Function &>(*cfg.func));
+        return dominatorsFromLLVM(domTree, cfg);
+    }
+
+    inline DomTreeView buildDominators(const IndexedCFG &cfg, DomEngineKind kind)
+    {
+        switch (kind)
+        {
+            case DomEngineKind::CooperHarveyKennedy:
+                return buildDominatorsCHK(cfg.graph);
+            case DomEngineKind::LengauerTarjan:
+                return buildDominatorsLT(cfg.graph);
+            case DomEngineKind::SemiNCA:
+                break;
+        }
+        return buildDominatorsSemiNCA(cfg);
+    }
+}
+
+#endif // BACKEDGES_DOMINATORENGINES_H
@@ -0,0 +1,349 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_FUNCTIONCACHE_H
+#define BACKEDGES_FUNCTIONCACHE_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/LockFileManager.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// <cache dir>/index.bin, host endian, only used on little endian hosts:
+//
+//   header   32 bytes, see FunctionCacheHeader
+//   entries  Count x FunctionCacheEntry, sorted by key
+//
+// A run maps the index once and looks keys up with a binary search in place. What it adds
+// is written back at the end: under a lock file the current index is read again, merged
+// with this run's entries and hits, cut down to the size limit, least recently used first,
+// written to a temporary file and renamed over the index. Readers never see a partial file,
+// runs that save at the same time take turns on the lock, and a run that cannot get the
+// lock does not save at all.
+namespace backedges
+{
+    const char FunctionCacheMagic[8] = {'B', 'E', 'C', 'A', 'C', 'H', 'E', '\0'};
+    const uint32_t FunctionCacheVersion = 1;
+
+    struct FunctionCacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t entrySize;
+        uint64_t count;
+        uint64_t reserved;
+    };
+
+    // one function's metric values, valid where mask has a bit set
+    struct FunctionCacheEntry
+    {
+        static const unsigned MaxValues = 16;
+
+        uint64_t key;
+        uint32_t numBlocks;
+        uint32_t mask;
+        int32_t values[MaxValues];
+        // the run that last stored or hit the entry, in seconds since the epoch
+        uint64_t lastUsed;
+    };
+
+    static_assert(sizeof(FunctionCacheHeader) == 32, "the header layout is part of the format");
+    static_assert(sizeof(FunctionCacheEntry) == 88, "the entry layout is part of the format");
+
+    class FunctionCache
+    {
+    public:
+        explicit FunctionCache(llvm::StringRef directory) : directory(directory)
+        {
+            llvm::sys::path::append(indexPath, directory, "index.bin");
+            runStamp = std::chrono::duration_cast<std::chrono::seconds>(
+                           std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        FunctionCache(const FunctionCache &) = delete;
+        FunctionCache &operator=(const FunctionCache &) = delete;
+
+        // a missing index is an empty cache, an unreadable one an error
+        bool open(std::string &error)
+        {
+            if (!llvm::sys::IsLittleEndianHost)
+            {
+                error = "the function cache is only kept on little endian hosts";
+                return false;
+            }
+            if (std::error_code EC = llvm::sys::fs::create_directories(directory))
+            {
+                error = "cannot create " + directory + ": " + EC.message();
+                return false;
+            }
+            return map(region, entries, count, error);
+        }
+
+        // from any thread; a hit needs every value in mask
+        bool lookup(uint64_t key, uint32_t mask, FunctionCacheEntry &entry)
+        {
+            const FunctionCacheEntry *end = entries + count;
+            const FunctionCacheEntry *found = std::lower_bound(entries, end, key, keyBelow);
+            if (found == end || found->key != key || (found->mask & mask) != mask)
+            {
+                misses++;
+                return false;
+            }
+            entry = *found;
+            hits++;
+            std::lock_guard<std::mutex> guard(lock);
+            used.push_back(key);
+            return true;
+        }
+
+        // from any thread, written back by save()
+        void store(const FunctionCacheEntry &entry)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            added.push_back(entry);
+            added.back().lastUsed = runStamp;
+        }
+
+        // merges this run into the index on disk and keeps it under maxBytes
+        bool save(uint64_t maxBytes, std::string &error)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (added.empty() && used.empty())
+            {
+                return true;
+            }
+            for (;;)
+            {
+                llvm::LockFileManager locked(indexPath);
+                switch (locked)
+                {
+                case llvm::LockFileManager::LFS_Shared:
+                    switch (locked.waitForUnlock())
+                    {
+                    case llvm::LockFileManager::Res_Success:
+                    case llvm::LockFileManager::Res_OwnerDied:
+                        continue;
+                    case llvm::LockFileManager::Res_Timeout:
+                        // an owner that hangs on to the lock, take it over
+                        locked.unsafeRemoveLockFile();
+                        continue;
+                    }
+                    break;
+                case llvm::LockFileManager::LFS_Owned:
+                    return write(maxBytes, error);
+                case llvm::LockFileManager::LFS_Error:
+                    // writing without the lock could drop another run's entries
+                    error = "cannot lock " + indexPath.str().str() + ": " + locked.getErrorMessage();
+                    return false;
+                }
+            }
+        }
+
+        size_t numHits() const
+        {
+            return hits;
+        }
+
+        size_t numMisses() const
+        {
+            return misses;
+        }
+
+        size_t numAdded() const
+        {
+            return added.size();
+        }
+
+    private:
+        std::string directory;
+        llvm::SmallString<128> indexPath;
+        uint64_t runStamp;
+
+        // the index as the run found it, read only
+        std::unique_ptr<llvm::sys::fs::mapped_file_region> region;
+        const FunctionCacheEntry *entries = nullptr;
+        uint64_t count = 0;
+
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+        std::mutex lock;
+        std::vector<FunctionCacheEntry> added;
+        std::vector<uint64_t> used;
+
+        static bool keyBelow(const FunctionCacheEntry &entry, uint64_t key)
+        {
+            return entry.key < key;
+        }
+
+        bool map(std::unique_ptr<llvm::sys::fs::mapped_file_region> &mapped, const FunctionCacheEntry *&first,
+                 uint64_t &size, std::string &error) const
+        {
+            mapped.reset();
+            first = nullptr;
+            size = 0;
+            uint64_t fileSize;
+            int fd;
+            if (llvm::sys::fs::file_size(indexPath, fileSize))
+            {
+                return true;
+            }
+            if (llvm::sys::fs::openFileForRead(indexPath, fd))
+            {
+                error = "cannot open " + indexPath.str().str();
+                return false;
+            }
+            if (fileSize < sizeof(FunctionCacheHeader))
+            {
+                llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+                error = indexPath.str().str() + ": too short for a header";
+                return false;
+            }
+            std::error_code EC;
+            mapped.reset(new llvm::sys::fs::mapped_file_region(fd, llvm::sys::fs::mapped_file_region::readonly,
+                                                               fileSize, 0, EC));
+            llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+            if (EC)
+            {
+                error = "cannot map " + indexPath.str().str() + ": " + EC.message();
+                return false;
+            }
+            const FunctionCacheHeader &header = *reinterpret_cast<const FunctionCacheHeader *>(mapped->const_data());
+            if (std::memcmp(header.magic, FunctionCacheMagic, sizeof(FunctionCacheMagic)) != 0 ||
+                header.version != FunctionCacheVersion || header.entrySize != sizeof(FunctionCacheEntry) ||
+                header.count > (fileSize - sizeof(FunctionCacheHeader)) / sizeof(FunctionCacheEntry))
+            {
+                error = indexPath.str().str() + ": not a version " + std::to_string(FunctionCacheVersion) +
+                        " function cache";
+                return false;
+            }
+            first = reinterpret_cast<const FunctionCacheEntry *>(mapped->const_data() + sizeof(FunctionCacheHeader));
+            size = header.count;
+            return true;
+        }
+
+        // with the lock held
+        bool write(uint64_t maxBytes, std::string &error)
+        {
+            // what is on disk now, other runs may have saved since open()
+            std::unique_ptr<llvm::sys::fs::mapped_file_region> current;
+            const FunctionCacheEntry *first;
+            uint64_t size;
+            if (!map(current, first, size, error))
+            {
+                return false;
+            }
+            std::vector<FunctionCacheEntry> merged(first, first + size);
+            current.reset();
+
+            std::sort(used.begin(), used.end());
+            for (FunctionCacheEntry &entry : merged)
+            {
+                if (std::binary_search(used.begin(), used.end(), entry.key))
+                {
+                    entry.lastUsed = runStamp;
+                }
+            }
+            // this run's entries win over what is there under the same key
+            merged.insert(merged.end(), added.begin(), added.end());
+            std::stable_sort(merged.begin(), merged.end(), [](const FunctionCacheEntry &a, const FunctionCacheEntry &b)
+            {
+                return a.key < b.key;
+            });
+            size_t kept = 0;
+            for (size_t index = 0; index < merged.size(); index++)
+            {
+                if (kept != 0 && merged[kept - 1].key == merged[index].key)
+                {
+                    merged[kept - 1] = merged[index];
+                }
+                else
+                {
+                    merged[kept++] = merged[index];
+                }
+            }
+            merged.resize(kept);
+
+            uint64_t capacity = maxBytes > sizeof(FunctionCacheHeader)
+                                    ? (maxBytes - sizeof(FunctionCacheHeader)) / sizeof(FunctionCacheEntry)
+                                    : 0;
+            if (merged.size() > capacity)
+            {
+                std::stable_sort(merged.begin(), merged.end(), [](const FunctionCacheEntry &a,
+                                                                  const FunctionCacheEntry &b)
+                {
+                    return a.lastUsed > b.lastUsed;
+                });
+                merged.resize(capacity);
+                std::sort(merged.begin(), merged.end(), [](const FunctionCacheEntry &a, const FunctionCacheEntry &b)
+                {
+                    return a.key < b.key;
+                });
+            }
+
+            int fd;
+            llvm::SmallString<128> temporary;
+            if (std::error_code EC = llvm::sys::fs::createUniqueFile(llvm::Twine(indexPath) + "-%%%%%%.tmp", fd, temporary))
+            {
+                error = "cannot create a temporary index in " + directory + ": " + EC.message();
+                return false;
+            }
+            {
+                llvm::raw_fd_ostream o(fd, true);
+                FunctionCacheHeader header;
+                std::memcpy(header.magic, FunctionCacheMagic, sizeof(FunctionCacheMagic));
+                header.version = FunctionCacheVersion;
+                header.entrySize = sizeof(FunctionCacheEntry);
+                header.count = merged.size();
+                header.reserved = 0;
+                o.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                o.write(reinterpret_cast<const char *>(merged.data()), merged.size() * sizeof(FunctionCacheEntry));
+                o.close();
+                if (o.has_error())
+                {
+                    o.clear_error();
+                    llvm::sys::fs::remove(temporary);
+                    error = "cannot write " + temporary.str().str();
+                    return false;
+                }
+            }
+            if (std::error_code EC = llvm::sys::fs::rename(temporary, indexPath))
+            {
+                llvm::sys::fs::remove(temporary);
+                error = "cannot replace " + indexPath.str().str() + ": " + EC.message();
+                return false;
+            }
+            added.clear();
+            used.clear();
+            return true;
+        }
+    };
+}
+
+#endif // BACKEDGES_FUNCTIONCACHE_H
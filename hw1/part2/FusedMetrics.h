@@ -0,0 +1,566 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_FUSEDMETRICS_H
+#define BACKEDGES_FUSEDMETRICS_H
+
+#include "CFGIndex.h"
+#include "DominatorEngines.h"
+#include "LoopForest.h"
+#include "ShapeMemo.h"
+#include "WarshallLoops.h"
+
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace backedges
+{
+    // goes into everything that stores metric values across runs, bump it when a metric
+    // starts counting differently
+    const uint32_t MetricsVersion = 1;
+
+    // What a metric gets to see of the function being measured. Everything is built once
+    // per function and shared by all the metrics of a set. shape is only there when CFG
+    // shapes are deduplicated, see measureDeduplicated.
+    struct FunctionView
+    {
+        const IndexedCFG &cfg;
+        const LoopForest &forest;
+        const DomTreeView &dominators;
+        const llvm::DominatorTree &domTree;
+        const llvm::PostDominatorTree &postDomTree;
+        ShapeResults *shape;
+    };
+
+    // The hooks a metric can implement, the ones it leaves alone compile to nothing.
+    // block and edge run in one pass over the CFG, edges right after their source block;
+    // loop runs over the loop forest in preorder. Every metric also has countName(), its
+    // series and testResults file, and passName(), the legacy pass that reports it and the
+    // name of its -passes pipeline element. The flags say how the summary is reported, the
+    // same as the arguments the pass of the metric gives createAndWriteJson.
+    struct MetricHooks
+    {
+        static constexpr bool Summation = false;
+        static constexpr bool Minimum = true;
+        static constexpr bool Average = true;
+        // dominator counts also report the average per block
+        static constexpr bool PerBlock = false;
+
+        int count = 0;
+
+        void beginFunction(const FunctionView &)
+        {
+            count = 0;
+        }
+
+        void block(const FunctionView &, unsigned) {}
+        void edge(const FunctionView &, unsigned, unsigned) {}
+        void loop(const FunctionView &, unsigned) {}
+        void endFunction(const FunctionView &) {}
+
+        int result() const
+        {
+            return count;
+        }
+    };
+
+    // -basicblock
+    struct BasicBlockMetric : MetricHooks
+    {
+        static const char *countName()
+        {
+            return "BasicBlockCount";
+        }
+
+        static const char *passName()
+        {
+            return "basicblock";
+        }
+
+        void block(const FunctionView &, unsigned)
+        {
+            count++;
+        }
+    };
+
+    // -cfgedge
+    struct CFGEdgeMetric : MetricHooks
+    {
+        static const char *countName()
+        {
+            return "CFGEdgeCount";
+        }
+
+        static const char *passName()
+        {
+            return "cfgedge";
+        }
+
+        void edge(const FunctionView &, unsigned, unsigned)
+        {
+            count++;
+        }
+    };
+
+    // -backedge: an edge into a loop header from inside the loop. A header's innermost loop
+    // is the loop it heads, so the test is O(1) on the forest.
+    struct BackEdgeMetric : MetricHooks
+    {
+        static const char *countName()
+        {
+            return "BackEdgeCount";
+        }
+
+        static const char *passName()
+        {
+            return "backedge";
+        }
+
+        void edge(const FunctionView &view, unsigned from, unsigned to)
+        {
+            unsigned loop = view.forest.innermostLoop(to);
+            if (loop != NoNode && view.forest.header[loop] == to && view.forest.contains(loop, from))
+            {
+                count++;
+            }
+        }
+    };
+
+    // -loopbasicblock: a top level loop's blocks already include its nested loops
+    struct LoopBasicBlockMetric : MetricHooks
+    {
+        static const char *countName()
+        {
+            return "LoopBasicBlockCount";
+        }
+
+        static const char *passName()
+        {
+            return "loopbasicblock";
+        }
+
+        void loop(const FunctionView &view, unsigned loop)
+        {
+            if (view.forest.isTopLevel(loop))
+            {
+                count += view.forest.numBlocks(loop);
+            }
+        }
+    };
+
+    // -dominatorspass
+    struct DominatorsMetric : MetricHooks
+    {
+        static constexpr bool PerBlock = true;
+
+        static const char *countName()
+        {
+            return "DominatorsCount";
+        }
+
+        static const char *passName()
+        {
+            return "dominatorspass";
+        }
+
+        void block(const FunctionView &view, unsigned node)
+        {
+            count += view.dominators.numDominators(node);
+        }
+    };
+
+    // -propdompass
+    struct ProperDominatorsMetric : MetricHooks
+    {
+        static constexpr bool PerBlock = true;
+
+        static const char *countName()
+        {
+            return "PropDominatorsPass";
+        }
+
+        static const char *passName()
+        {
+            return "propdompass";
+        }
+
+        void block(const FunctionView &view, unsigned node)
+        {
+            count += view.dominators.numProperDominators(node);
+        }
+    };
+
+    // -allloops
+    struct AllLoopsMetric : MetricHooks
+    {
+        static constexpr bool Summation = true;
+        static constexpr bool Minimum = false;
+        static constexpr bool Average = false;
+
+        static const char *countName()
+        {
+            return "AllLoopsCount";
+        }
+
+        static const char *passName()
+        {
+            return "allloops";
+        }
+
+        void loop(const FunctionView &, unsigned)
+        {
+            count++;
+        }
+    };
+
+    // -toploops
+    struct TopLoopsMetric : MetricHooks
+    {
+        static constexpr bool Summation = true;
+        static constexpr bool Minimum = false;
+
+        static const char *countName()
+        {
+            return "TopLoopCount";
+        }
+
+        static const char *passName()
+        {
+            return "toploops";
+        }
+
+        void loop(const FunctionView &view, unsigned loop)
+        {
+            if (view.forest.isTopLevel(loop))
+            {
+                count++;
+            }
+        }
+    };
+
+    // -exitcfgloops: blocks that exit their innermost loop. A block's edges come one after
+    // the other, so remembering the last block counted keeps each block to one.
+    struct LoopExitMetric : MetricHooks
+    {
+        static constexpr bool Summation = true;
+        static constexpr bool Minimum = false;
+
+        unsigned lastExiting = NoNode;
+
+        static const char *countName()
+        {
+            return "LoopExitCFGCount";
+        }
+
+        static const char *passName()
+        {
+            return "exitcfgloops";
+        }
+
+        void beginFunction(const FunctionView &view)
+        {
+            MetricHooks::beginFunction(view);
+            lastExiting = NoNode;
+        }
+
+        void edge(const FunctionView &view, unsigned from, unsigned to)
+        {
+            unsigned loop = view.forest.innermostLoop(from);
+            if (loop != NoNode && from != lastExiting && !view.forest.contains(loop, to))
+            {
+                lastExiting = from;
+                count++;
+            }
+        }
+    };
+
+    // -warshloopdetector: the cycle based count has no per block form, it runs on the
+    // whole function once the walk is done
+    struct WarshallMetric : MetricHooks
+    {
+        static constexpr bool Summation = true;
+        static constexpr bool Minimum = false;
+
+        static const char *countName()
+        {
+            return "WarshLoopCount";
+        }
+
+        static const char *passName()
+        {
+            return "warshloopdetector";
+        }
+
+        void endFunction(const FunctionView &view)
+        {
+            if (view.shape != nullptr && view.shape->has(WarshallShape))
+            {
+                count = view.shape->values[WarshallShape];
+                return;
+            }
+            WarshallLoopDetector detector(view.domTree, llvm::nulls(), false);
+            count = detector.countLoops(*view.cfg.func);
+            if (view.shape != nullptr)
+            {
+                view.shape->set(WarshallShape, count);
+            }
+        }
+    };
+
+    // -controldep: the (j, edge i -> s) pairs where j post-dominates s but not i. Those j are
+    // the post-dominator tree ancestors of s below the first one that also post-dominates i,
+    // so each edge walks that part of the tree instead of testing every block.
+    struct ControlDependenceMetric : MetricHooks
+    {
+        static constexpr bool Summation = true;
+        static constexpr bool Minimum = false;
+
+        static const char *countName()
+        {
+            return "ControlDependence";
+        }
+
+        static const char *passName()
+        {
+            return "controldep";
+        }
+
+        void edge(const FunctionView &view, unsigned from, unsigned to)
+        {
+            if (view.shape != nullptr && view.shape->has(ControlDependenceShape))
+            {
+                return;
+            }
+            const llvm::BasicBlock *source = view.cfg.blocks[from];
+            for (const llvm::DomTreeNode *node = view.postDomTree.getNode(view.cfg.blocks[to]);
+                 node != nullptr && node->getBlock() != nullptr; node = node->getIDom())
+            {
+                if (view.postDomTree.dominates(node->getBlock(), source))
+                {
+                    break;
+                }
+                count++;
+            }
+        }
+
+        void endFunction(const FunctionView &view)
+        {
+            if (view.shape == nullptr)
+            {
+                return;
+            }
+            if (view.shape->has(ControlDependenceShape))
+            {
+                count = view.shape->values[ControlDependenceShape];
+            }
+            else
+            {
+                view.shape->set(ControlDependenceShape, count);
+            }
+        }
+    };
+
+    // -reachable: the ordered pairs (a, b) with a path of at least one edge from a to b, a
+    // search from every block over the CSR graph with one visited stamp array
+    struct ReachableMetric : MetricHooks
+    {
+        static constexpr bool Summation = true;
+        static constexpr bool Minimum = false;
+
+        std::vector<unsigned> stamp;
+        std::vector<unsigned> worklist;
+
+        static const char *countName()
+        {
+            return "NodesReachable";
+        }
+
+        static const char *passName()
+        {
+            return "reachable";
+        }
+
+        void endFunction(const FunctionView &view)
+        {
+            if (view.shape != nullptr && view.shape->has(ReachableShape))
+            {
+                count = view.shape->values[ReachableShape];
+                return;
+            }
+            const CSRGraph &graph = view.cfg.graph;
+            stamp.assign(graph.numNodes, NoNode);
+            for (unsigned source = 0; source < graph.numNodes; source++)
+            {
+                worklist.clear();
+                worklist.push_back(source);
+                while (!worklist.empty())
+                {
+                    unsigned node = worklist.back();
+                    worklist.pop_back();
+                    for (unsigned succ : graph.successors(node))
+                    {
+                        if (stamp[succ] != source)
+                        {
+                            stamp[succ] = source;
+                            count++;
+                            worklist.push_back(succ);
+                        }
+                    }
+                }
+            }
+            if (view.shape != nullptr)
+            {
+                view.shape->set(ReachableShape, count);
+            }
+        }
+    };
+
+    // A list of metrics fused at compile time: every hook of the set calls the hook of each
+    // metric in turn, the calls are inlined, so one walk feeds them all.
+    template <typename... Metrics>
+    class MetricSet;
+
+    template <>
+    class MetricSet<>
+    {
+    public:
+        static constexpr unsigned size = 0;
+
+        void beginFunction(const FunctionView &) {}
+        void block(const FunctionView &, unsigned) {}
+        void edge(const FunctionView &, unsigned, unsigned) {}
+        void loop(const FunctionView &, unsigned) {}
+        void endFunction(const FunctionView &) {}
+
+        template <typename Visitor>
+        void forEach(Visitor &) {}
+    };
+
+    template <typename First, typename... Rest>
+    class MetricSet<First, Rest...> : public MetricSet<Rest...>
+    {
+    public:
+        typedef MetricSet<Rest...> RestSet;
+        static constexpr unsigned size = 1 + sizeof...(Rest);
+
+        void beginFunction(const FunctionView &view)
+        {
+            metric.beginFunction(view);
+            RestSet::beginFunction(view);
+        }
+
+        void block(const FunctionView &view, unsigned node)
+        {
+            metric.block(view, node);
+            RestSet::block(view, node);
+        }
+
+        void edge(const FunctionView &view, unsigned from, unsigned to)
+        {
+            metric.edge(view, from, to);
+            RestSet::edge(view, from, to);
+        }
+
+        void loop(const FunctionView &view, unsigned loop)
+        {
+            metric.loop(view, loop);
+            RestSet::loop(view, loop);
+        }
+
+        void endFunction(const FunctionView &view)
+        {
+            metric.endFunction(view);
+            RestSet::endFunction(view);
+        }
+
+        // visitor(metric) for every metric, in the order of the list
+        template <typename Visitor>
+        void forEach(Visitor &visitor)
+        {
+            visitor(metric);
+            RestSet::forEach(visitor);
+        }
+
+    private:
+        First metric;
+    };
+
+    // a set's results in list order
+    struct CollectResults
+    {
+        std::vector<int> &results;
+
+        template <typename Metric>
+        void operator()(const Metric &metric)
+        {
+            results.push_back(metric.result());
+        }
+    };
+
+    // every metric there is, in the order the passes are listed in countBackEdges2_3.cpp
+    typedef MetricSet<BasicBlockMetric,
+                      CFGEdgeMetric,
+                      BackEdgeMetric,
+                      LoopBasicBlockMetric,
+                      DominatorsMetric,
+                      ProperDominatorsMetric,
+                      AllLoopsMetric,
+                      TopLoopsMetric,
+                      LoopExitMetric,
+                      WarshallMetric,
+                      ControlDependenceMetric,
+                      ReachableMetric> AllMetrics;
+
+    // the single traversal: blocks with their outgoing edges, then the loops. Takes a
+    // MetricSet or a lone metric, they have the same hooks.
+    template <typename Hooks>
+    void measureFunction(Hooks &metrics, const FunctionView &view)
+    {
+        const CSRGraph &graph = view.cfg.graph;
+        metrics.beginFunction(view);
+        for (unsigned node = 0; node < graph.numNodes; node++)
+        {
+            metrics.block(view, node);
+            for (unsigned succ : graph.successors(node))
+            {
+                metrics.edge(view, node, succ);
+            }
+        }
+        for (unsigned loop = 0; loop < view.forest.numLoops(); loop++)
+        {
+            metrics.loop(view, loop);
+        }
+        metrics.endFunction(view);
+    }
+
+    // measureFunction with the shape metrics taken from memo when a function with the same
+    // CFG shape has been measured before, and added to it when not
+    template <typename Hooks>
+    void measureDeduplicated(Hooks &metrics, FunctionView view, ShapeMemo &memo)
+    {
+        CanonicalShape shape(view.cfg, view.postDomTree);
+        ShapeResults results;
+        memo.lookup(shape, results);
+        view.shape = &results;
+        measureFunction(metrics, view);
+        memo.store(shape, results);
+    }
+}
+
+#endif // BACKEDGES_FUSEDMETRICS_H
@@ -0,0 +1,160 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_LOOPFOREST_H
+#define BACKEDGES_LOOPFOREST_H
+
+#include "CFGIndex.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+
+#include <vector>
+
+namespace backedges
+{
+    // The LoopInfo forest flattened into arrays. Loops are numbered in preorder so the loops
+    // nested in L are exactly [L, subtreeEnd[L]). Every block is stored once in blocks,
+    // grouped by its innermost loop in loop preorder, which makes the blocks of L (nested
+    // loops included) the contiguous range [blockBegin[L], blockEnd[L]).
+    struct LoopForest
+    {
+        std::vector<const llvm::Loop *> loops; // loop index -> llvm::Loop
+        std::vector<unsigned> parent;          // NoNode for top level loops
+        std::vector<unsigned> depth;           // 1 for top level loops, like Loop::getLoopDepth()
+        std::vector<unsigned> subtreeEnd;
+        std::vector<unsigned> header;          // block index of the header
+        std::vector<unsigned> blockBegin;
+        std::vector<unsigned> blockEnd;
+        std::vector<unsigned> blocks;          // block indices of all loop blocks
+        std::vector<unsigned> innermost;       // block index -> innermost loop, NoNode outside loops
+
+        LoopForest() {}
+
+        LoopForest(const llvm::LoopInfo &loopInfo, const IndexedCFG &cfg)
+        {
+            llvm::DenseMap<const llvm::Loop *, unsigned> loopIndex;
+            std::vector<const llvm::Loop *> stack;
+            // LoopInfo keeps top level loops in reverse program order
+            for (auto iter = loopInfo.rbegin(); iter != loopInfo.rend(); ++iter)
+            {
+                stack.push_back(*iter);
+            }
+            while (!stack.empty())
+            {
+                const llvm::Loop *loop = stack.back();
+                stack.pop_back();
+                unsigned self = loops.size();
+                loopIndex[loop] = self;
+                loops.push_back(loop);
+                const llvm::Loop *parentLoop = loop->getParentLoop();
+                parent.push_back(parentLoop == nullptr ? NoNode : loopIndex.lookup(parentLoop));
+                depth.push_back(parentLoop == nullptr ? 1 : depth[parent.back()] + 1);
+                header.push_back(cfg.indexOf(loop->getHeader()));
+                const std::vector<llvm::Loop *> &subLoops = loop->getSubLoops();
+                for (auto iter = subLoops.rbegin(); iter != subLoops.rend(); ++iter)
+                {
+                    stack.push_back(*iter);
+                }
+            }
+
+            const unsigned numLoops = loops.size();
+            subtreeEnd.assign(numLoops, 0);
+            for (unsigned idx = numLoops; idx-- > 0;)
+            {
+                if (subtreeEnd[idx] == 0)
+                {
+                    subtreeEnd[idx] = idx + 1;
+                }
+                if (parent[idx] != NoNode && subtreeEnd[parent[idx]] < subtreeEnd[idx])
+                {
+                    subtreeEnd[parent[idx]] = subtreeEnd[idx];
+                }
+            }
+
+            // counting sort of the blocks by innermost loop
+            innermost.assign(cfg.size(), NoNode);
+            std::vector<unsigned> ownCount(numLoops + 1, 0);
+            for (unsigned node = 0; node < cfg.size(); node++)
+            {
+                const llvm::Loop *loop = loopInfo.getLoopFor(cfg.blocks[node]);
+                if (loop != nullptr)
+                {
+                    innermost[node] = loopIndex.lookup(loop);
+                    ownCount[innermost[node] + 1]++;
+                }
+            }
+            for (unsigned idx = 0; idx < numLoops; idx++)
+            {
+                ownCount[idx + 1] += ownCount[idx];
+            }
+            blocks.resize(ownCount[numLoops]);
+            std::vector<unsigned> fill(ownCount.begin(), ownCount.end() - 1);
+            for (unsigned node = 0; node < cfg.size(); node++)
+            {
+                if (innermost[node] != NoNode)
+                {
+                    blocks[fill[innermost[node]]++] = node;
+                }
+            }
+            blockBegin.assign(ownCount.begin(), ownCount.end() - 1);
+            blockEnd.resize(numLoops);
+            for (unsigned idx = 0; idx < numLoops; idx++)
+            {
+                blockEnd[idx] = subtreeEnd[idx] < numLoops ? blockBegin[subtreeEnd[idx]] : blocks.size();
+            }
+        }
+
+        unsigned numLoops() const
+        {
+            return loops.size();
+        }
+
+        unsigned numBlocks(unsigned loop) const
+        {
+            return blockEnd[loop] - blockBegin[loop];
+        }
+
+        llvm::ArrayRef<unsigned> blocksOf(unsigned loop) const
+        {
+            return llvm::ArrayRef<unsigned>(blocks.data() + blockBegin[loop], numBlocks(loop));
+        }
+
+        unsigned innermostLoop(unsigned block) const
+        {
+            return innermost[block];
+        }
+
+        bool contains(unsigned loop, unsigned block) const
+        {
+            unsigned inner = innermost[block];
+            return inner != NoNode && loop <= inner && inner < subtreeEnd[loop];
+        }
+
+        // 0 for blocks outside every loop, like LoopInfo::getLoopDepth()
+        unsigned loopDepth(unsigned block) const
+        {
+            return innermost[block] == NoNode ? 0 : depth[innermost[block]];
+        }
+
+        bool isTopLevel(unsigned loop) const
+        {
+            return parent[loop] == NoNode;
+        }
+    };
+}
+
+#endif // BACKEDGES_LOOPFOREST_H
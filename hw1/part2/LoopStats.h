@@ -0,0 +1,105 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_LOOPSTATS_H
+#define BACKEDGES_LOOPSTATS_H
+
+#include "CFGIndex.h"
+#include "LoopForest.h"
+
+#include "llvm/Analysis/LoopInfo.h"
+
+#include <vector>
+
+namespace backedges
+{
+    struct LoopCounts
+    {
+        unsigned numBackEdges = 0;     // in-loop predecessors of the header, Loop::getNumBackEdges()
+        unsigned numExitingBlocks = 0; // blocks with a successor outside this loop
+        unsigned numExitEdges = 0;     // CFG edges leaving this loop, duplicates counted
+    };
+
+    // Everything the loop passes report, gathered in one walk over the flattened loop forest.
+    // Depth, parent and block counts per loop live in the forest, counts is indexed the same way.
+    struct LoopStats
+    {
+        LoopForest forest;
+        std::vector<LoopCounts> counts;
+        unsigned numTopLevelLoops = 0;
+        unsigned numTopLevelLoopBlocks = 0;
+        unsigned numBackEdges = 0;
+        // blocks that exit their innermost loop, what LoopInfo::getLoopFor + isLoopExiting counted
+        unsigned numInnermostExitingBlocks = 0;
+        unsigned numExitEdges = 0;
+
+        unsigned numLoops() const
+        {
+            return forest.numLoops();
+        }
+    };
+
+    inline LoopStats computeLoopStats(const llvm::LoopInfo &loopInfo, const IndexedCFG &cfg)
+    {
+        LoopStats stats;
+        stats.forest = LoopForest(loopInfo, cfg);
+        const LoopForest &forest = stats.forest;
+        stats.counts.resize(forest.numLoops());
+
+        for (unsigned loop = 0; loop < forest.numLoops(); loop++)
+        {
+            LoopCounts &counts = stats.counts[loop];
+            for (unsigned pred : cfg.graph.predecessors(forest.header[loop]))
+            {
+                if (forest.contains(loop, pred))
+                {
+                    counts.numBackEdges++;
+                }
+            }
+
+            for (unsigned node : forest.blocksOf(loop))
+            {
+                unsigned exits = 0;
+                for (unsigned succ : cfg.graph.successors(node))
+                {
+                    if (!forest.contains(loop, succ))
+                    {
+                        exits++;
+                    }
+                }
+                counts.numExitEdges += exits;
+                if (exits != 0)
+                {
+                    counts.numExitingBlocks++;
+                    if (forest.innermostLoop(node) == loop)
+                    {
+                        stats.numInnermostExitingBlocks++;
+                    }
+                }
+            }
+
+            stats.numBackEdges += counts.numBackEdges;
+            stats.numExitEdges += counts.numExitEdges;
+            if (forest.isTopLevel(loop))
+            {
+                stats.numTopLevelLoops++;
+                stats.numTopLevelLoopBlocks += forest.numBlocks(loop);
+            }
+        }
+        return stats;
+    }
+}
+
+#endif // BACKEDGES_LOOPSTATS_H
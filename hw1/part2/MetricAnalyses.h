@@ -0,0 +1,178 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_METRICANALYSES_H
+#define BACKEDGES_METRICANALYSES_H
+
+#include "CFGIndex.h"
+#include "DominatorEngines.h"
+#include "FusedMetrics.h"
+#include "LoopForest.h"
+#include "ShapeMemo.h"
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+#include <vector>
+
+namespace backedges
+{
+    // The metrics only look at the CFG, so their results outlive any pass that keeps it
+    inline bool preservesCFGResult(llvm::PreservedAnalyses::PreservedAnalysisChecker checker)
+    {
+        return checker.preserved() || checker.preservedSet<llvm::CFGAnalyses>();
+    }
+
+    // New pass manager analysis behind every metric: the CFG index, the loop forest and the
+    // dominator tree view a FunctionView points at. The LLVM trees come from the analysis
+    // manager's cache and go with it. Key is defined in countBackEdges2_3.cpp.
+    class FunctionViewAnalysis : public llvm::AnalysisInfoMixin<FunctionViewAnalysis>
+    {
+    public:
+        class Result
+        {
+        public:
+            Result(const llvm::Function &F, const llvm::LoopInfo &loopInfo, const llvm::DominatorTree &domTree,
+                   const llvm::PostDominatorTree &postDomTree, DomEngineKind engine, ShapeMemo *memo)
+                : cfg(F), forest(loopInfo, cfg),
+                  dominators(engine == DomEngineKind::SemiNCA ? dominatorsFromLLVM(domTree, cfg)
+                                                              : buildDominators(cfg, engine)),
+                  domTree(&domTree), postDomTree(&postDomTree), memo(memo) {}
+
+            FunctionView view() const
+            {
+                FunctionView view = {cfg, forest, dominators, *domTree, *postDomTree, nullptr};
+                return view;
+            }
+
+            // a metric or a set over the view, through the shape memo when there is one
+            template <typename Hooks>
+            void measure(Hooks &metrics) const
+            {
+                if (memo != nullptr)
+                {
+                    measureDeduplicated(metrics, view(), *memo);
+                }
+                else
+                {
+                    measureFunction(metrics, view());
+                }
+            }
+
+            // the forest keeps Loop pointers and the view the trees, they go when those do
+            bool invalidate(llvm::Function &F, const llvm::PreservedAnalyses &PA,
+                            llvm::FunctionAnalysisManager::Invalidator &Inv)
+            {
+                return !preservesCFGResult(PA.getChecker<FunctionViewAnalysis>()) ||
+                       Inv.invalidate<llvm::LoopAnalysis>(F, PA) ||
+                       Inv.invalidate<llvm::DominatorTreeAnalysis>(F, PA) ||
+                       Inv.invalidate<llvm::PostDominatorTreeAnalysis>(F, PA);
+            }
+
+        private:
+            IndexedCFG cfg;
+            LoopForest forest;
+            DomTreeView dominators;
+            const llvm::DominatorTree *domTree;
+            const llvm::PostDominatorTree *postDomTree;
+            ShapeMemo *memo;
+        };
+
+        // with a memo the shape metrics are computed once per CFG shape, see measureDeduplicated
+        explicit FunctionViewAnalysis(DomEngineKind engine = DomEngineKind::SemiNCA, ShapeMemo *memo = nullptr)
+            : engine(engine), memo(memo) {}
+
+        Result run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM)
+        {
+            return Result(F, FAM.getResult<llvm::LoopAnalysis>(F), FAM.getResult<llvm::DominatorTreeAnalysis>(F),
+                          FAM.getResult<llvm::PostDominatorTreeAnalysis>(F), engine, memo);
+        }
+
+    private:
+        friend llvm::AnalysisInfoMixin<FunctionViewAnalysis>;
+        static llvm::AnalysisKey Key;
+        DomEngineKind engine;
+        ShapeMemo *memo;
+    };
+
+    // One metric's value for a function, cached by the analysis manager until the CFG changes
+    template <typename Metric>
+    class MetricAnalysis : public llvm::AnalysisInfoMixin<MetricAnalysis<Metric>>
+    {
+    public:
+        struct Result
+        {
+            int count;
+
+            bool invalidate(llvm::Function &, const llvm::PreservedAnalyses &PA,
+                            llvm::FunctionAnalysisManager::Invalidator &)
+            {
+                return !preservesCFGResult(PA.getChecker<MetricAnalysis>());
+            }
+        };
+
+        Result run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM)
+        {
+            Metric metric;
+            FAM.getResult<FunctionViewAnalysis>(F).measure(metric);
+            Result result = {metric.result()};
+            return result;
+        }
+
+    private:
+        friend llvm::AnalysisInfoMixin<MetricAnalysis<Metric>>;
+        static llvm::AnalysisKey Key;
+    };
+
+    template <typename Metric>
+    llvm::AnalysisKey MetricAnalysis<Metric>::Key;
+
+    // Every metric from one traversal, what -allstats reports. counts follows the order of
+    // AllMetrics. Key is defined in countBackEdges2_3.cpp.
+    class AllMetricsAnalysis : public llvm::AnalysisInfoMixin<AllMetricsAnalysis>
+    {
+    public:
+        struct Result
+        {
+            std::vector<int> counts;
+
+            bool invalidate(llvm::Function &, const llvm::PreservedAnalyses &PA,
+                            llvm::FunctionAnalysisManager::Invalidator &)
+            {
+                return !preservesCFGResult(PA.getChecker<AllMetricsAnalysis>());
+            }
+        };
+
+        Result run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM)
+        {
+            AllMetrics metrics;
+            FAM.getResult<FunctionViewAnalysis>(F).measure(metrics);
+            Result result;
+            result.counts.reserve(AllMetrics::size);
+            CollectResults collect = {result.counts};
+            metrics.forEach(collect);
+            return result;
+        }
+
+    private:
+        friend llvm::AnalysisInfoMixin<AllMetricsAnalysis>;
+        static llvm::AnalysisKey Key;
+    };
+}
+
+#endif // BACKEDGES_METRICANALYSES_H
@@ -0,0 +1,172 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_METRICMETADATA_H
+#define BACKEDGES_METRICMETADATA_H
+
+#include "FusedMetrics.h"
+#include "StructuralHash.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Type.h"
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// The metrics of a function kept on the function itself, as a !backedges.metrics attachment:
+//
+//   define i32 @f24(i32 %n) !backedges.metrics !7 { ... }
+//   !7 = !{i64 <structural hash>, i32 <MetricsVersion>, i32 <mask>, [12 x i32] [...]}
+//
+// values follow the order of AllMetrics and are valid where mask has the metric's bit set.
+// A tuple only counts while the function's structural hash and the metrics version still
+// match, so bitcode that was transformed after the metrics were attached is measured again.
+// Attachments go wherever the function goes, through llvm-link and -o alike.
+namespace backedges
+{
+    const char MetricMetadataName[] = "backedges.metrics";
+
+    // Metric's place in AllMetrics, the bit it has in a mask
+    template <typename Metric>
+    struct MetricIndex
+    {
+        unsigned next;
+        unsigned index;
+
+        template <typename Other>
+        void operator()(const Other &)
+        {
+            if (std::is_same<Metric, Other>::value)
+            {
+                index = next;
+            }
+            next++;
+        }
+
+        static unsigned get()
+        {
+            MetricIndex<Metric> find = {0, 0};
+            AllMetrics().forEach(find);
+            return find.index;
+        }
+    };
+
+    // Reads and attaches the tuples, counting how many lookups it could answer
+    class MetricMetadata
+    {
+    public:
+        static const uint32_t AllMask = (1u << AllMetrics::size) - 1;
+
+        // the values of F in mask, when its tuple is still valid for this code
+        bool lookup(const llvm::Function &F, uint64_t hash, uint32_t mask, std::vector<int> &values)
+        {
+            uint32_t found;
+            if (!read(F, hash, found, values) || (found & mask) != mask)
+            {
+                misses++;
+                return false;
+            }
+            hits++;
+            return true;
+        }
+
+        // F's values in mask, the others it has are kept while the hash is the same
+        void update(llvm::Function &F, uint64_t hash, uint32_t mask, const std::vector<int> &values)
+        {
+            uint32_t merged;
+            std::vector<int> packed;
+            if (!read(F, hash, merged, packed))
+            {
+                merged = 0;
+                packed.assign(AllMetrics::size, 0);
+            }
+            for (unsigned index = 0; index < AllMetrics::size; index++)
+            {
+                if ((mask >> index) & 1)
+                {
+                    packed[index] = values[index];
+                }
+            }
+            merged |= mask;
+
+            llvm::LLVMContext &ctx = F.getContext();
+            llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+            std::vector<uint32_t> elements(packed.begin(), packed.end());
+            llvm::Metadata *operands[] = {
+                llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx), hash)),
+                llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i32, MetricsVersion)),
+                llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i32, merged)),
+                llvm::ConstantAsMetadata::get(llvm::ConstantDataArray::get(ctx, elements))};
+            F.setMetadata(MetricMetadataName, llvm::MDTuple::get(ctx, operands));
+        }
+
+        size_t numHits() const
+        {
+            return hits;
+        }
+
+        size_t numMisses() const
+        {
+            return misses;
+        }
+
+    private:
+        size_t hits = 0;
+        size_t misses = 0;
+
+        // false when F has no tuple, one of the wrong shape, or one for other code or
+        // another metrics version
+        static bool read(const llvm::Function &F, uint64_t hash, uint32_t &mask, std::vector<int> &values)
+        {
+            const llvm::MDNode *node = F.getMetadata(MetricMetadataName);
+            if (node == nullptr || node->getNumOperands() != 4)
+            {
+                return false;
+            }
+            const llvm::ConstantInt *stored = llvm::mdconst::dyn_extract_or_null<llvm::ConstantInt>(node->getOperand(0));
+            const llvm::ConstantInt *version =
+                llvm::mdconst::dyn_extract_or_null<llvm::ConstantInt>(node->getOperand(1));
+            const llvm::ConstantInt *valid = llvm::mdconst::dyn_extract_or_null<llvm::ConstantInt>(node->getOperand(2));
+            // all zeros comes back as zeroinitializer rather than a data array
+            const llvm::Constant *array = llvm::mdconst::dyn_extract_or_null<llvm::Constant>(node->getOperand(3));
+            llvm::ArrayType *type = array != nullptr ? llvm::dyn_cast<llvm::ArrayType>(array->getType()) : nullptr;
+            if (stored == nullptr || version == nullptr || valid == nullptr || type == nullptr ||
+                stored->getZExtValue() != hash || version->getZExtValue() != MetricsVersion ||
+                type->getNumElements() != AllMetrics::size)
+            {
+                return false;
+            }
+            mask = valid->getZExtValue() & AllMask;
+            values.resize(AllMetrics::size);
+            for (unsigned index = 0; index < AllMetrics::size; index++)
+            {
+                const llvm::ConstantInt *value =
+                    llvm::dyn_cast_or_null<llvm::ConstantInt>(array->getAggregateElement(index));
+                if (value == nullptr)
+                {
+                    return false;
+                }
+                values[index] = static_cast<int>(value->getSExtValue());
+            }
+            return true;
+        }
+    };
+}
+
+#endif // BACKEDGES_METRICMETADATA_H
@@ -0,0 +1,215 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_METRICSUMMARY_H
+#define BACKEDGES_METRICSUMMARY_H
+
+#include "PercentileSketch.h"
+#include "StatsWriter.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace backedges
+{
+    // What a counting pass reports at the end of the module. write() emits the keys in the
+    // sorted order the old nlohmann objects had, the per function records are streamed into
+    // the "Test" slot by the caller so they never have to be copied into a document.
+    struct MetricSummary
+    {
+        std::string countName;
+        bool hasMinimum = true;
+        bool hasAverage = true;
+        bool hasSummation = false;
+        double average = 0;
+        int64_t summation = 0;
+        int maximum = 0;
+        int minimum = 0;
+        std::string maximumName;
+        std::string minimumName;
+
+        // -dominatorspass and -propdompass, dominators per block
+        bool hasDomByBlock = false;
+        double domByBlockAverage = 0;
+        double domByBlockMax = 0;
+        double domByBlockMin = 0;
+        std::string domByBlockMaxName;
+        std::string domByBlockMinName;
+
+        // -loop-tier=fast
+        bool hasTier = false;
+        int64_t irreducibleFunctions = 0;
+
+        // -stats-sketch, percentiles in the summary and the histogram itself in the file
+        bool hasPercentiles = false;
+        LogHistogram sketch;
+
+        // -stats-extended, spread and the largest functions
+        bool hasSpread = false;
+        double stddev = 0;
+        std::vector<std::pair<std::string, int>> top;
+
+        // the file gets the per function records and the sketch, the errs() line neither
+        void write(JsonStreamWriter &writer, llvm::function_ref<void(JsonStreamWriter &)> writeTest = nullptr,
+                   bool withSketch = false) const
+        {
+            writer.beginObject();
+            if (hasAverage)
+            {
+                writer.field("Average", average);
+            }
+            if (hasDomByBlock)
+            {
+                writer.field("DomByBlockAverage", domByBlockAverage);
+                writer.key("DomByBlockMax");
+                writeNamedValue(writer, domByBlockMaxName, domByBlockMax);
+                writer.key("DomByBlockMin");
+                writeNamedValue(writer, domByBlockMinName, domByBlockMin);
+            }
+            if (hasTier)
+            {
+                writer.field("IrreducibleFunctions", irreducibleFunctions);
+            }
+            writer.key("Maximum");
+            writeFunctionCount(writer, maximumName, maximum);
+            if (hasMinimum)
+            {
+                writer.key("Minimum");
+                writeFunctionCount(writer, minimumName, minimum);
+            }
+            if (hasPercentiles)
+            {
+                writer.key("Percentiles");
+                writer.beginObject();
+                writer.field("p50", sketch.percentile(0.5));
+                writer.field("p90", sketch.percentile(0.9));
+                writer.field("p99", sketch.percentile(0.99));
+                writer.field("p999", sketch.percentile(0.999));
+                writer.endObject();
+                if (withSketch)
+                {
+                    writer.key("Sketch");
+                    sketch.write(writer);
+                }
+            }
+            if (hasSpread)
+            {
+                writer.field("StdDev", stddev);
+            }
+            if (hasSummation)
+            {
+                writer.field("Summation", summation);
+            }
+            if (writeTest)
+            {
+                writer.key("Test");
+                writeTest(writer);
+            }
+            if (hasTier)
+            {
+                writer.field("Tier", "fast");
+            }
+            if (hasSpread)
+            {
+                writer.key("Top");
+                writer.beginArray();
+                for (const std::pair<std::string, int> &entry : top)
+                {
+                    writeFunctionCount(writer, entry.first, entry.second);
+                }
+                writer.endArray();
+            }
+            writer.endObject();
+        }
+
+        // the one line summary the passes print to errs()
+        void print(llvm::raw_ostream &os) const
+        {
+            JsonStreamWriter writer(os);
+            write(writer);
+        }
+
+    private:
+        // count names are capitalized, so they sort before "functionName"
+        void writeFunctionCount(JsonStreamWriter &writer, llvm::StringRef name, int count) const
+        {
+            writer.beginObject();
+            writer.field(countName, count);
+            writer.field("functionName", name);
+            writer.endObject();
+        }
+
+        static void writeNamedValue(JsonStreamWriter &writer, llvm::StringRef name, double value)
+        {
+            writer.beginArray();
+            writer.value(name);
+            writer.value(value);
+            writer.endArray();
+        }
+    };
+
+    inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MetricSummary &summary)
+    {
+        summary.print(os);
+        return os;
+    }
+
+    // The per function rows behind a summary, in the order the functions were visited.
+    // DomPerBlock is only there for the dominator passes.
+    struct ResultRows
+    {
+        size_t size;
+        llvm::function_ref<llvm::StringRef(size_t)> name;
+        llvm::function_ref<int(size_t)> value;
+        bool hasDomPerBlock;
+        llvm::function_ref<double(size_t)> domPerBlock;
+    };
+
+    // the layout of testResults/<CountName>.json, rows go into "Test" when there are any
+    inline void writeResultsJson(llvm::raw_ostream &os, const MetricSummary &summary, const ResultRows *rows)
+    {
+        JsonStreamWriter writer(os, 4);
+        if (rows == nullptr)
+        {
+            summary.write(writer, nullptr, true);
+            os << "\n";
+            return;
+        }
+        summary.write(writer, [&](JsonStreamWriter &test)
+        {
+            test.beginArray();
+            for (size_t i = 0; i < rows->size; i++)
+            {
+                test.beginObject();
+                if (rows->hasDomPerBlock)
+                {
+                    test.field("DomPerBlock", rows->domPerBlock(i));
+                }
+                test.field(summary.countName, rows->value(i));
+                test.field("functionName", rows->name(i));
+                test.endObject();
+            }
+            test.endArray();
+        }, true);
+        os << "\n";
+    }
+}
+
+#endif // BACKEDGES_METRICSUMMARY_H
@@ -0,0 +1,93 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_NAMETABLE_H
+#define BACKEDGES_NAMETABLE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace backedges
+{
+    const uint32_t NoName = ~0u;
+
+    // Function names interned once into an arena and handed out as 32 bit ids, so the passes
+    // keep 4 bytes per function instead of their own std::string copy of every name.
+    // Ids are dense and given out in first seen order. The table is locked, the async writer
+    // looks names up while the passes may still be interning.
+    class NameTable
+    {
+    public:
+        NameTable() : saver(arena) {}
+        NameTable(const NameTable &) = delete;
+        NameTable &operator=(const NameTable &) = delete;
+
+        uint32_t intern(llvm::StringRef name)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = ids.find(name);
+            if (found != ids.end())
+            {
+                return found->second;
+            }
+            llvm::StringRef saved = saver.save(name);
+            uint32_t id = names.size();
+            names.push_back(saved);
+            ids.insert(std::make_pair(saved, id));
+            return id;
+        }
+
+        // NoName reads back as the empty string, what an empty series reported before
+        llvm::StringRef name(uint32_t id) const
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return id == NoName ? llvm::StringRef() : names[id];
+        }
+
+        unsigned size() const
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return names.size();
+        }
+
+        size_t memoryFootprint() const
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return arena.getTotalMemory() + ids.getMemorySize() + names.capacity() * sizeof(llvm::StringRef);
+        }
+
+        // the table every pass in the plugin shares
+        static NameTable &shared()
+        {
+            static NameTable table;
+            return table;
+        }
+
+    private:
+        mutable std::mutex lock;
+        llvm::BumpPtrAllocator arena;
+        llvm::StringSaver saver;
+        llvm::DenseMap<llvm::StringRef, uint32_t> ids;
+        std::vector<llvm::StringRef> names;
+    };
+}
+
+#endif // BACKEDGES_NAMETABLE_H
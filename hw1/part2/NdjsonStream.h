@@ -0,0 +1,102 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_NDJSONSTREAM_H
+#define BACKEDGES_NDJSONSTREAM_H
+
+#include "MetricSummary.h"
+#include "StatsWriter.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+
+namespace backedges
+{
+    // -stats-ndjson: one compact line per function, written as soon as the pass is done with
+    // it, and a {"Summary":{...}} line at the end of the module. The lines carry the keys of
+    // the "Test" records in testResults/<CountName>.json. Output goes out in blocks of
+    // BlockSize bytes, so a run that dies keeps everything up to the last full block.
+    class NdjsonStream
+    {
+    public:
+        static const size_t BlockSize = 1 << 20;
+
+        // false if the file cannot be created, the stream then stays closed
+        bool open(const llvm::Twine &path, llvm::StringRef countName)
+        {
+            std::error_code EC;
+            std::unique_ptr<llvm::raw_fd_ostream> file(new llvm::raw_fd_ostream(path.str(), EC, llvm::sys::fs::F_Text));
+            if (EC)
+            {
+                return false;
+            }
+            file->SetBufferSize(BlockSize);
+            os = std::move(file);
+            name = countName.str();
+            return true;
+        }
+
+        bool isOpen() const
+        {
+            return os != nullptr;
+        }
+
+        // {"<CountName>":value,"functionName":"..."}
+        void record(llvm::StringRef functionName, int value)
+        {
+            JsonStreamWriter writer(*os);
+            writer.beginObject();
+            writer.field(name, value);
+            writer.field("functionName", functionName);
+            writer.endObject();
+            *os << "\n";
+        }
+
+        // the dominator passes also have the per block average
+        void record(llvm::StringRef functionName, int value, double domPerBlock)
+        {
+            JsonStreamWriter writer(*os);
+            writer.beginObject();
+            writer.field("DomPerBlock", domPerBlock);
+            writer.field(name, value);
+            writer.field("functionName", functionName);
+            writer.endObject();
+            *os << "\n";
+        }
+
+        // the last line, the stream is closed after it
+        void finish(const MetricSummary &summary)
+        {
+            JsonStreamWriter writer(*os);
+            writer.beginObject();
+            writer.key("Summary");
+            summary.write(writer, nullptr, true);
+            writer.endObject();
+            *os << "\n";
+            os.reset();
+        }
+
+    private:
+        std::unique_ptr<llvm::raw_fd_ostream> os;
+        std::string name;
+    };
+}
+
+#endif // BACKEDGES_NDJSONSTREAM_H
@@ -0,0 +1,213 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_PERCENTILESKETCH_H
+#define BACKEDGES_PERCENTILESKETCH_H
+
+#include "StatsWriter.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace backedges
+{
+    // HDR style log bucketed histogram over non negative 32 bit values. Values below 2^SubBucketBits
+    // get a bucket each, above that every power of two is split into 2^(SubBucketBits-1) buckets,
+    // so a reported percentile is within 1/32 of the true value. The layout is fixed, which
+    // makes two sketches mergeable by adding their counts, and costs 7KB whatever the input size.
+    class LogHistogram
+    {
+    public:
+        static const unsigned SubBucketBits = 6;
+        static const unsigned SubBucketCount = 1u << SubBucketBits;
+        static const unsigned HalfCount = SubBucketCount / 2;
+        static const unsigned NumBuckets = SubBucketCount + (32 - SubBucketBits) * HalfCount;
+
+        // a sketch starts disabled and takes no memory until it is enabled
+        void enable()
+        {
+            buckets.assign(NumBuckets, 0);
+        }
+
+        bool isEnabled() const
+        {
+            return !buckets.empty();
+        }
+
+        // counts are never negative, anything below zero is recorded as zero
+        void add(int64_t value)
+        {
+            if (!isEnabled())
+            {
+                return;
+            }
+            uint32_t clamped = static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(value, 0), UINT32_MAX));
+            buckets[indexOf(clamped)]++;
+            min = count == 0 ? clamped : std::min(min, clamped);
+            max = count == 0 ? clamped : std::max(max, clamped);
+            count++;
+        }
+
+        void merge(const LogHistogram &other)
+        {
+            if (!other.isEnabled() || other.count == 0)
+            {
+                return;
+            }
+            if (!isEnabled())
+            {
+                enable();
+            }
+            for (unsigned index = 0; index < NumBuckets; index++)
+            {
+                buckets[index] += other.buckets[index];
+            }
+            min = count == 0 ? other.min : std::min(min, other.min);
+            max = count == 0 ? other.max : std::max(max, other.max);
+            count += other.count;
+        }
+
+        uint64_t getCount() const
+        {
+            return count;
+        }
+
+        // smallest recorded value v such that at least quantile * count values are <= v,
+        // reported as the top of its bucket and clamped to the observed range
+        uint32_t percentile(double quantile) const
+        {
+            if (count == 0)
+            {
+                return 0;
+            }
+            uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * count)));
+            uint64_t seen = 0;
+            for (unsigned index = 0; index < NumBuckets; index++)
+            {
+                seen += buckets[index];
+                if (seen >= rank)
+                {
+                    return std::max(min, std::min(max, upperBound(index)));
+                }
+            }
+            return max;
+        }
+
+        // {"SubBucketBits":6,"Count":n,"Min":a,"Max":b,"Buckets":[[index,count],...]}, only the
+        // non empty buckets are listed
+        void write(JsonStreamWriter &writer) const
+        {
+            writer.beginObject();
+            writer.field("SubBucketBits", static_cast<unsigned>(SubBucketBits));
+            writer.field("Count", count);
+            writer.field("Min", min);
+            writer.field("Max", max);
+            writer.key("Buckets");
+            writer.beginArray();
+            for (unsigned index = 0; index < buckets.size(); index++)
+            {
+                if (buckets[index] != 0)
+                {
+                    writer.beginArray();
+                    writer.value(index);
+                    writer.value(buckets[index]);
+                    writer.endArray();
+                }
+            }
+            writer.endArray();
+            writer.endObject();
+        }
+
+        // reads what write() produced, false if it is malformed or the layout does not match
+        static bool read(const nlohmann::json &j, LogHistogram &sketch)
+        {
+            if (!j.is_object())
+            {
+                return false;
+            }
+            auto bits = j.find("SubBucketBits");
+            auto buckets = j.find("Buckets");
+            if (bits == j.end() || !bits->is_number_unsigned() || bits->get<unsigned>() != SubBucketBits ||
+                buckets == j.end() || !buckets->is_array())
+            {
+                return false;
+            }
+            LogHistogram result;
+            result.enable();
+            for (const nlohmann::json &bucket : *buckets)
+            {
+                if (!bucket.is_array() || bucket.size() != 2 ||
+                    !bucket[0].is_number_unsigned() || !bucket[1].is_number_unsigned())
+                {
+                    return false;
+                }
+                unsigned index = bucket[0].get<unsigned>();
+                if (index >= NumBuckets)
+                {
+                    return false;
+                }
+                result.buckets[index] += bucket[1].get<uint64_t>();
+                result.count += bucket[1].get<uint64_t>();
+            }
+            result.min = j.value("Min", 0u);
+            result.max = j.value("Max", 0u);
+            if (result.count != j.value("Count", uint64_t(0)))
+            {
+                return false;
+            }
+            sketch = std::move(result);
+            return true;
+        }
+
+    private:
+        uint64_t count = 0;
+        uint32_t min = 0;
+        uint32_t max = 0;
+        std::vector<uint64_t> buckets;
+
+        static unsigned indexOf(uint32_t value)
+        {
+            if (value < SubBucketCount)
+            {
+                return value;
+            }
+            unsigned exponent = llvm::Log2_32(value);
+            unsigned shift = exponent - (SubBucketBits - 1);
+            return SubBucketCount + (exponent - SubBucketBits) * HalfCount + ((value >> shift) - HalfCount);
+        }
+
+        static uint32_t upperBound(unsigned index)
+        {
+            if (index < SubBucketCount)
+            {
+                return index;
+            }
+            unsigned offset = index - SubBucketCount;
+            unsigned exponent = SubBucketBits + offset / HalfCount;
+            unsigned shift = exponent - (SubBucketBits - 1);
+            uint64_t top = HalfCount + offset % HalfCount;
+            return static_cast<uint32_t>(((top + 1) << shift) - 1);
+        }
+    };
+}
+
+#endif // BACKEDGES_PERCENTILESKETCH_H
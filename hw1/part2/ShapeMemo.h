@@ -0,0 +1,240 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_SHAPEMEMO_H
+#define BACKEDGES_SHAPEMEMO_H
+
+#include "CFGIndex.h"
+#include "StructuralHash.h"
+
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace backedges
+{
+    // The metrics whose value is a function of the CFG alone, nothing else in the function
+    enum ShapeMetric : unsigned
+    {
+        WarshallShape,
+        ControlDependenceShape,
+        ReachableShape,
+        NumShapeMetrics
+    };
+
+    // A CFG relabeled so that isomorphic CFGs come out equal: reachable blocks in reverse
+    // postorder from the entry, the unreachable ones after them in layout order, and every
+    // block's successors in terminator order under the new labels. The encoding is kept, not
+    // just the hash, so a collision cannot hand a function another shape's results.
+    // The post-dominator roots go in as well: when a block cannot reach a return,
+    // PostDominatorTree picks the extra roots by layout order, which the labels leave out.
+    struct CanonicalShape
+    {
+        uint64_t hash = 0;
+        // numNodes, then per block in label order its successor count and successor labels,
+        // then the number of post-dominator roots and their labels in ascending order
+        std::vector<unsigned> encoding;
+
+        CanonicalShape(const IndexedCFG &cfg, const llvm::PostDominatorTree &postDomTree)
+        {
+            const CSRGraph &graph = cfg.graph;
+            DFSNumbering dfs(graph);
+            std::vector<unsigned> label(graph.numNodes, NoNode);
+            std::vector<unsigned> order(dfs.postorder.rbegin(), dfs.postorder.rend());
+            for (unsigned node = 0; node < graph.numNodes; node++)
+            {
+                if (!dfs.isReachable(node))
+                {
+                    order.push_back(node);
+                }
+            }
+            for (unsigned index = 0; index < order.size(); index++)
+            {
+                label[order[index]] = index;
+            }
+            encoding.reserve(2 + graph.numNodes + graph.numEdges());
+            encoding.push_back(graph.numNodes);
+            for (unsigned node : order)
+            {
+                llvm::ArrayRef<unsigned> succList = graph.successors(node);
+                encoding.push_back(succList.size());
+                for (unsigned succ : succList)
+                {
+                    encoding.push_back(label[succ]);
+                }
+            }
+            std::vector<unsigned> roots;
+            for (const llvm::BasicBlock *root : postDomTree.getRoots())
+            {
+                roots.push_back(label[cfg.indexOf(root)]);
+            }
+            std::sort(roots.begin(), roots.end());
+            encoding.push_back(roots.size());
+            encoding.insert(encoding.end(), roots.begin(), roots.end());
+            StableHash stable;
+            for (unsigned value : encoding)
+            {
+                stable.add(value);
+            }
+            hash = stable.get();
+        }
+    };
+
+    // One function's shape metrics. The memo fills in what it knows before the function
+    // is measured; a metric that finds its bit in known takes the value instead of computing
+    // it, one that computes it sets its bit in computed.
+    struct ShapeResults
+    {
+        uint32_t known = 0;
+        uint32_t computed = 0;
+        int values[NumShapeMetrics] = {};
+
+        bool has(ShapeMetric metric) const
+        {
+            return (known >> metric) & 1;
+        }
+
+        void set(ShapeMetric metric, int value)
+        {
+            values[metric] = value;
+            computed |= 1u << metric;
+        }
+    };
+
+    // Shape metric values by canonical CFG, for as long as the memo lives. Lookups and
+    // stores come from any thread; the table is split in shards by hash so they seldom wait.
+    class ShapeMemo
+    {
+    public:
+        ShapeMemo() = default;
+        ShapeMemo(const ShapeMemo &) = delete;
+        ShapeMemo &operator=(const ShapeMemo &) = delete;
+
+        void lookup(const CanonicalShape &shape, ShapeResults &results)
+        {
+            Shard &shard = shardOf(shape);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto found = shard.entries.find(shape.hash);
+            if (found == shard.entries.end())
+            {
+                return;
+            }
+            for (const Entry &entry : found->second)
+            {
+                if (entry.encoding == shape.encoding)
+                {
+                    results.known = entry.results.known;
+                    std::copy(entry.results.values, entry.results.values + NumShapeMetrics, results.values);
+                    return;
+                }
+            }
+        }
+
+        // after the function is measured: what it computed goes into the memo, what it
+        // took from there counts as a hit
+        void store(const CanonicalShape &shape, const ShapeResults &results)
+        {
+            for (unsigned metric = 0; metric < NumShapeMetrics; metric++)
+            {
+                bool hit = (results.known >> metric) & 1;
+                bool miss = (results.computed >> metric) & 1;
+                hits[metric] += hit;
+                lookups[metric] += hit || miss;
+            }
+            if (results.computed == 0)
+            {
+                return;
+            }
+            Shard &shard = shardOf(shape);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            std::vector<Entry> &entries = shard.entries[shape.hash];
+            for (Entry &entry : entries)
+            {
+                if (entry.encoding == shape.encoding)
+                {
+                    merge(entry.results, results);
+                    return;
+                }
+            }
+            entries.push_back(Entry{shape.encoding, ShapeResults()});
+            merge(entries.back().results, results);
+            numShapes++;
+        }
+
+        // "shape memo: N shapes, Warshall h/n hits (p%), ..."
+        void printHitRates(llvm::raw_ostream &os) const
+        {
+            static const char *const names[NumShapeMetrics] = {"Warshall", "ControlDependence", "Reachable"};
+            os << "shape memo: " << numShapes.load() << " shapes";
+            for (unsigned metric = 0; metric < NumShapeMetrics; metric++)
+            {
+                size_t total = lookups[metric];
+                if (total == 0)
+                {
+                    continue;
+                }
+                os << ", " << names[metric] << " " << hits[metric].load() << "/" << total << " hits ("
+                   << llvm::format("%.1f", 100.0 * hits[metric] / total) << "%)";
+            }
+            os << "\n";
+        }
+
+    private:
+        static const unsigned NumShards = 16;
+
+        struct Entry
+        {
+            std::vector<unsigned> encoding;
+            ShapeResults results;
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex lock;
+            std::unordered_map<uint64_t, std::vector<Entry>> entries;
+        };
+
+        Shard shards[NumShards];
+        std::atomic<size_t> numShapes{0};
+        std::atomic<size_t> hits[NumShapeMetrics] = {};
+        std::atomic<size_t> lookups[NumShapeMetrics] = {};
+
+        Shard &shardOf(const CanonicalShape &shape)
+        {
+            return shards[shape.hash % NumShards];
+        }
+
+        static void merge(ShapeResults &into, const ShapeResults &from)
+        {
+            for (unsigned metric = 0; metric < NumShapeMetrics; metric++)
+            {
+                if ((from.computed >> metric) & 1)
+                {
+                    into.values[metric] = from.values[metric];
+                    into.known |= 1u << metric;
+                }
+            }
+        }
+    };
+}
+
+#endif // BACKEDGES_SHAPEMEMO_H
@@ -0,0 +1,148 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_SHARDEDRESULTS_H
+#define BACKEDGES_SHARDEDRESULTS_H
+
+#include "CacheLineArray.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace backedges
+{
+    // Per function results coming in from any number of threads, each keyed by the index of
+    // its function in the module, and handed on strictly in index order. Every thread adds to
+    // its own shard, so adding never waits on another thread's lock unless there are more
+    // threads than shards. Since the consumer sees the results in function order whatever
+    // thread produced them, summaries and files come out the same for 1 or 64 threads.
+    template <typename T>
+    class ShardedResults
+    {
+    public:
+        explicit ShardedResults(unsigned numShards = defaultShards())
+            : shards(numShards), numShards(numShards) {}
+
+        ShardedResults(const ShardedResults &) = delete;
+        ShardedResults &operator=(const ShardedResults &) = delete;
+
+        // from any thread, every index once
+        void add(unsigned functionIndex, T value)
+        {
+            Shard &shard = shards[threadSlot() % numShards];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            shard.entries.push_back(Entry{functionIndex, std::move(value)});
+        }
+
+        // consume(index, value) for the results from the next index on, up to the first one
+        // still missing. With one thread adding in order every result goes straight through.
+        // Returns right away if another thread is draining.
+        template <typename Consume>
+        void drainReady(Consume &&consume)
+        {
+            std::unique_lock<std::mutex> guard(drainLock, std::try_to_lock);
+            if (!guard.owns_lock())
+            {
+                return;
+            }
+            collect();
+            while (!pending.empty() && pending.front().functionIndex == next)
+            {
+                std::pop_heap(pending.begin(), pending.end(), laterIndex);
+                Entry entry = std::move(pending.back());
+                pending.pop_back();
+                consume(entry.functionIndex, entry.value);
+                next++;
+            }
+        }
+
+        // the end of the module: everything left in index order, across any gaps
+        template <typename Consume>
+        void drainAll(Consume &&consume)
+        {
+            std::lock_guard<std::mutex> guard(drainLock);
+            collect();
+            std::sort(pending.begin(), pending.end(), [](const Entry &a, const Entry &b)
+            {
+                return a.functionIndex < b.functionIndex;
+            });
+            for (Entry &entry : pending)
+            {
+                consume(entry.functionIndex, entry.value);
+                next = entry.functionIndex + 1;
+            }
+            pending.clear();
+        }
+
+        static unsigned defaultShards()
+        {
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+
+    private:
+        struct Entry
+        {
+            unsigned functionIndex;
+            T value;
+        };
+
+        // a cache line each, so threads adding to neighbouring shards do not share one
+        struct Shard
+        {
+            std::mutex lock;
+            std::vector<Entry> entries;
+        };
+
+        CacheLineArray<Shard> shards;
+        const unsigned numShards;
+        std::mutex drainLock;
+        // a min heap on the index, only touched with drainLock held
+        std::vector<Entry> pending;
+        unsigned next = 0;
+
+        static bool laterIndex(const Entry &a, const Entry &b)
+        {
+            return a.functionIndex > b.functionIndex;
+        }
+
+        void collect()
+        {
+            for (unsigned index = 0; index < numShards; index++)
+            {
+                std::lock_guard<std::mutex> guard(shards[index].lock);
+                for (Entry &entry : shards[index].entries)
+                {
+                    pending.push_back(std::move(entry));
+                    std::push_heap(pending.begin(), pending.end(), laterIndex);
+                }
+                shards[index].entries.clear();
+            }
+        }
+
+        // threads get consecutive slots the first time they add anywhere
+        static unsigned threadSlot()
+        {
+            static std::atomic<unsigned> nextSlot(0);
+            thread_local unsigned slot = nextSlot.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+    };
+}
+
+#endif // BACKEDGES_SHARDEDRESULTS_H
@@ -0,0 +1,304 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_STATSACCUMULATOR_H
+#define BACKEDGES_STATSACCUMULATOR_H
+
+#include "NameTable.h"
+#include "NdjsonStream.h"
+#include "PercentileSketch.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace backedges
+{
+    // Count, sum, Welford mean and variance, min and max with the function that produced
+    // them, updated once per function so a pass can report without keeping its values.
+    // The passes name functions by the Function's own name, which outlives the report, the
+    // shards and the merge tool by a copy. Ties on min and max go to the later function,
+    // which is what the old rescans reported.
+    template <typename T, typename Name = llvm::StringRef>
+    class OnlineStats
+    {
+    public:
+        // integer metrics are summed exactly, the average stays sum / count as before
+        using SumType = typename std::conditional<std::is_integral<T>::value, int64_t, double>::type;
+
+        void add(T value, const Name &name)
+        {
+            count++;
+            sum += value;
+            double delta = value - mean;
+            mean += delta / count;
+            m2 += delta * (value - mean);
+            if (count == 1 || value >= max)
+            {
+                max = value;
+                argMax = name;
+            }
+            if (count == 1 || value <= min)
+            {
+                min = value;
+                argMin = name;
+            }
+        }
+
+        // Chan et al. pairwise combination; other is treated as coming after this one
+        void merge(const OnlineStats &other)
+        {
+            if (other.count == 0)
+            {
+                return;
+            }
+            if (count == 0)
+            {
+                *this = other;
+                return;
+            }
+            uint64_t total = count + other.count;
+            double delta = other.mean - mean;
+            mean += delta * other.count / total;
+            m2 += other.m2 + delta * delta * count * other.count / total;
+            count = total;
+            sum += other.sum;
+            if (other.max >= max)
+            {
+                max = other.max;
+                argMax = other.argMax;
+            }
+            if (other.min <= min)
+            {
+                min = other.min;
+                argMin = other.argMin;
+            }
+        }
+
+        // rebuilds an accumulator from its saved state, see StatsShard.h
+        static OnlineStats fromParts(uint64_t count, SumType sum, double mean, double m2,
+                                     T min, const Name &argMin, T max, const Name &argMax)
+        {
+            OnlineStats stats;
+            stats.count = count;
+            stats.sum = sum;
+            stats.mean = mean;
+            stats.m2 = m2;
+            stats.min = min;
+            stats.argMin = argMin;
+            stats.max = max;
+            stats.argMax = argMax;
+            return stats;
+        }
+
+        // the same state with every function name passed through resolve
+        template <typename Resolve>
+        auto rename(Resolve resolve) const -> OnlineStats<T, decltype(resolve(std::declval<Name>()))>
+        {
+            using Renamed = OnlineStats<T, decltype(resolve(std::declval<Name>()))>;
+            return Renamed::fromParts(count, sum, mean, m2, min, resolve(argMin), max, resolve(argMax));
+        }
+
+        uint64_t getCount() const { return count; }
+        SumType getSum() const { return sum; }
+        double getMean() const { return mean; }
+        double getM2() const { return m2; }
+        T getMax() const { return max; }
+        T getMin() const { return min; }
+        const Name &getArgMax() const { return argMax; }
+        const Name &getArgMin() const { return argMin; }
+
+        double average() const
+        {
+            return sum / static_cast<double>(count);
+        }
+
+        // population variance of everything added so far
+        double variance() const
+        {
+            return count == 0 ? 0 : m2 / count;
+        }
+
+        double stddev() const
+        {
+            return std::sqrt(variance());
+        }
+
+    private:
+        uint64_t count = 0;
+        SumType sum = 0;
+        double mean = 0;
+        double m2 = 0;
+        T max = T();
+        T min = T();
+        Name argMax = Name();
+        Name argMin = Name();
+    };
+
+    // The k largest values seen, in a min-heap of fixed size so the cheapest entry is the
+    // one replaced. Equal values keep the earlier function.
+    template <typename T, typename Name = llvm::StringRef>
+    class TopK
+    {
+    public:
+        struct Entry
+        {
+            T value;
+            uint64_t order;
+            Name name;
+        };
+
+        explicit TopK(unsigned k = 0) : k(k) {}
+
+        void setLimit(unsigned limit)
+        {
+            k = limit;
+            entries.clear();
+        }
+
+        unsigned getLimit() const
+        {
+            return k;
+        }
+
+        void add(T value, const Name &name)
+        {
+            insert(Entry{value, seen++, name});
+        }
+
+        // other's functions count as coming after everything seen here
+        void merge(const TopK &other)
+        {
+            k = std::max(k, other.k);
+            for (const Entry &entry : other.entries)
+            {
+                insert(Entry{entry.value, seen + entry.order, entry.name});
+            }
+            seen += other.seen;
+        }
+
+        template <typename Resolve>
+        auto rename(Resolve resolve) const -> TopK<T, decltype(resolve(std::declval<Name>()))>
+        {
+            TopK<T, decltype(resolve(std::declval<Name>()))> renamed(k);
+            for (const Entry &entry : sorted())
+            {
+                renamed.insert({entry.value, entry.order, resolve(entry.name)});
+            }
+            renamed.seen = seen;
+            return renamed;
+        }
+
+        // largest first
+        std::vector<Entry> sorted() const
+        {
+            std::vector<Entry> result(entries);
+            std::sort(result.begin(), result.end(), ranksBefore);
+            return result;
+        }
+
+        // how many values the entries were picked from, merge() orders the next series after them
+        void setSeen(uint64_t count)
+        {
+            seen = std::max(seen, count);
+        }
+
+        // an entry read back from a shard, order is its position among everything seen
+        void insert(const Entry &entry)
+        {
+            seen = std::max(seen, entry.order + 1);
+            if (k == 0)
+            {
+                return;
+            }
+            if (entries.size() < k)
+            {
+                entries.push_back(entry);
+                std::push_heap(entries.begin(), entries.end(), ranksBefore);
+                return;
+            }
+            if (!ranksBefore(entry, entries.front()))
+            {
+                return;
+            }
+            std::pop_heap(entries.begin(), entries.end(), ranksBefore);
+            entries.back() = entry;
+            std::push_heap(entries.begin(), entries.end(), ranksBefore);
+        }
+
+    private:
+        template <typename, typename> friend class TopK;
+
+        unsigned k;
+        uint64_t seen = 0;
+        std::vector<Entry> entries;
+
+        // larger values and then earlier functions first; as a heap order the root is the
+        // entry to evict first
+        static bool ranksBefore(const Entry &a, const Entry &b)
+        {
+            if (a.value != b.value)
+            {
+                return a.value > b.value;
+            }
+            return a.order < b.order;
+        }
+    };
+
+    // what a pass keeps per function when it keeps anything: 8 bytes for an int metric
+    template <typename T>
+    struct FunctionRecord
+    {
+        uint32_t nameId;
+        T value;
+    };
+
+    // One metric of one pass: the online summary always, a percentile sketch when enabled,
+    // the per function records only when the detail output asks for them. Only the records
+    // intern names, into the shared NameTable where every pass gets the same id for the same
+    // name, so a series that keeps no values allocates nothing per function. ndjson is only
+    // opened for -stats-ndjson, the pass writes to it as it adds.
+    template <typename T>
+    struct MetricSeries
+    {
+        OnlineStats<T> stats;
+        TopK<T> top;
+        LogHistogram sketch;
+        bool keepValues;
+        std::vector<FunctionRecord<T>> records;
+        NdjsonStream ndjson;
+
+        explicit MetricSeries(bool keepValues = false) : keepValues(keepValues) {}
+
+        // name has to stay valid until the series is reported
+        void add(llvm::StringRef name, T value)
+        {
+            stats.add(value, name);
+            top.add(value, name);
+            sketch.add(value);
+            if (keepValues)
+            {
+                records.push_back(FunctionRecord<T>{NameTable::shared().intern(name), value});
+            }
+        }
+    };
+}
+
+#endif // BACKEDGES_STATSACCUMULATOR_H
@@ -0,0 +1,364 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_STATSSHARD_H
+#define BACKEDGES_STATSSHARD_H
+
+#include "MetricSummary.h"
+#include "PercentileSketch.h"
+#include "StatsAccumulator.h"
+#include "StatsWriter.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace backedges
+{
+    const char *const ShardFormat = "backedges-stats-shard";
+    const unsigned ShardVersion = 1;
+
+    // One metric the way a shard carries it: the accumulators rather than their summary, with
+    // function names spelled out, so the shards of many runs merge into exact global count,
+    // sum, mean, variance, min and max and the sketch into approximate percentiles.
+    struct ShardMetric
+    {
+        std::string countName;
+        uint64_t runs = 1;
+        bool hasSummation = false;
+        bool hasMinimum = true;
+        bool hasAverage = true;
+        bool extended = false;
+        bool hasTier = false;
+        int64_t irreducibleFunctions = 0;
+        OnlineStats<int, std::string> stats;
+        TopK<int, std::string> top;
+        LogHistogram sketch;
+        // dominators per block of -dominatorspass and -propdompass
+        bool hasByBlock = false;
+        OnlineStats<double, std::string> byBlock;
+
+        // other's functions count as coming after this one's, merge in a fixed order to get
+        // the same ties every time
+        void merge(const ShardMetric &other)
+        {
+            runs += other.runs;
+            hasSummation |= other.hasSummation;
+            hasMinimum |= other.hasMinimum;
+            hasAverage |= other.hasAverage;
+            extended |= other.extended;
+            hasTier |= other.hasTier;
+            irreducibleFunctions += other.irreducibleFunctions;
+            stats.merge(other.stats);
+            top.merge(other.top);
+            sketch.merge(other.sketch);
+            hasByBlock |= other.hasByBlock;
+            byBlock.merge(other.byBlock);
+        }
+
+        MetricSummary summarize() const
+        {
+            MetricSummary summary;
+            summary.countName = countName;
+            summary.hasSummation = hasSummation;
+            summary.hasMinimum = hasMinimum;
+            summary.hasAverage = hasAverage;
+            summary.summation = stats.getSum();
+            summary.average = stats.average();
+            summary.maximum = stats.getMax();
+            summary.maximumName = stats.getArgMax();
+            summary.minimum = stats.getMin();
+            summary.minimumName = stats.getArgMin();
+            if (hasByBlock)
+            {
+                summary.hasDomByBlock = true;
+                summary.domByBlockAverage = byBlock.average();
+                summary.domByBlockMax = byBlock.getMax();
+                summary.domByBlockMaxName = byBlock.getArgMax();
+                summary.domByBlockMin = byBlock.getMin();
+                summary.domByBlockMinName = byBlock.getArgMin();
+            }
+            if (hasTier)
+            {
+                summary.hasTier = true;
+                summary.irreducibleFunctions = irreducibleFunctions;
+            }
+            if (sketch.isEnabled())
+            {
+                summary.hasPercentiles = true;
+                summary.sketch = sketch;
+            }
+            if (extended)
+            {
+                summary.hasSpread = true;
+                summary.stddev = stats.stddev();
+                for (const TopK<int, std::string>::Entry &entry : top.sorted())
+                {
+                    summary.top.push_back(std::make_pair(entry.name, entry.value));
+                }
+            }
+            return summary;
+        }
+
+        void write(JsonStreamWriter &writer) const
+        {
+            writer.beginObject();
+            writer.field("CountName", countName);
+            writer.field("Runs", runs);
+            writer.key("Reports");
+            writer.beginObject();
+            writer.field("Summation", hasSummation);
+            writer.field("Minimum", hasMinimum);
+            writer.field("Average", hasAverage);
+            writer.field("Extended", extended);
+            writer.endObject();
+            if (hasTier)
+            {
+                writer.field("Tier", "fast");
+                writer.field("IrreducibleFunctions", irreducibleFunctions);
+            }
+            writer.key("Stats");
+            writeStats(writer, stats);
+            if (top.getLimit() != 0)
+            {
+                writer.key("Top");
+                writer.beginObject();
+                writer.field("Limit", top.getLimit());
+                writer.key("Entries");
+                writer.beginArray();
+                for (const TopK<int, std::string>::Entry &entry : top.sorted())
+                {
+                    writer.beginArray();
+                    writer.value(entry.value);
+                    writer.value(entry.order);
+                    writer.value(entry.name);
+                    writer.endArray();
+                }
+                writer.endArray();
+                writer.endObject();
+            }
+            if (sketch.isEnabled())
+            {
+                writer.key("Sketch");
+                sketch.write(writer);
+            }
+            if (hasByBlock)
+            {
+                writer.key("ByBlock");
+                writeStats(writer, byBlock);
+            }
+            writer.endObject();
+        }
+
+        // false on anything that is not what write() produced
+        static bool read(const nlohmann::json &j, ShardMetric &metric)
+        {
+            if (!j.is_object())
+            {
+                return false;
+            }
+            ShardMetric result;
+            auto countName = j.find("CountName");
+            auto reports = j.find("Reports");
+            auto stats = j.find("Stats");
+            if (countName == j.end() || !countName->is_string() || reports == j.end() || !reports->is_object() ||
+                stats == j.end() || !readStats(*stats, result.stats))
+            {
+                return false;
+            }
+            result.countName = countName->get<std::string>();
+            result.runs = j.value("Runs", uint64_t(1));
+            result.hasSummation = reports->value("Summation", false);
+            result.hasMinimum = reports->value("Minimum", true);
+            result.hasAverage = reports->value("Average", true);
+            result.extended = reports->value("Extended", false);
+            result.hasTier = j.find("Tier") != j.end();
+            result.irreducibleFunctions = j.value("IrreducibleFunctions", int64_t(0));
+
+            auto top = j.find("Top");
+            if (top != j.end())
+            {
+                auto entries = top->find("Entries");
+                if (!top->is_object() || entries == top->end() || !entries->is_array())
+                {
+                    return false;
+                }
+                result.top.setLimit(top->value("Limit", 0u));
+                for (const nlohmann::json &entry : *entries)
+                {
+                    if (!entry.is_array() || entry.size() != 3 || !entry[0].is_number_integer() ||
+                        !entry[1].is_number_unsigned() || !entry[2].is_string())
+                    {
+                        return false;
+                    }
+                    result.top.insert({entry[0].get<int>(), entry[1].get<uint64_t>(), entry[2].get<std::string>()});
+                }
+            }
+            // the top entries only know their own positions, the series may have seen more
+            result.top.setSeen(result.stats.getCount());
+
+            auto sketch = j.find("Sketch");
+            if (sketch != j.end() && !LogHistogram::read(*sketch, result.sketch))
+            {
+                return false;
+            }
+            auto byBlock = j.find("ByBlock");
+            if (byBlock != j.end())
+            {
+                if (!readStats(*byBlock, result.byBlock))
+                {
+                    return false;
+                }
+                result.hasByBlock = true;
+            }
+            metric = std::move(result);
+            return true;
+        }
+
+    private:
+        template <typename T>
+        static void writeStats(JsonStreamWriter &writer, const OnlineStats<T, std::string> &stats)
+        {
+            writer.beginObject();
+            writer.field("Count", stats.getCount());
+            writer.field("Sum", stats.getSum());
+            writer.field("Mean", stats.getMean());
+            writer.field("M2", stats.getM2());
+            writer.field("Min", stats.getMin());
+            writer.field("ArgMin", stats.getArgMin());
+            writer.field("Max", stats.getMax());
+            writer.field("ArgMax", stats.getArgMax());
+            writer.endObject();
+        }
+
+        template <typename T>
+        static bool readStats(const nlohmann::json &j, OnlineStats<T, std::string> &stats)
+        {
+            static const char *const NumberKeys[] = {"Count", "Sum", "Mean", "M2", "Min", "Max"};
+            static const char *const NameKeys[] = {"ArgMin", "ArgMax"};
+            if (!j.is_object())
+            {
+                return false;
+            }
+            for (const char *key : NumberKeys)
+            {
+                auto found = j.find(key);
+                if (found == j.end() || !found->is_number())
+                {
+                    return false;
+                }
+            }
+            for (const char *key : NameKeys)
+            {
+                auto found = j.find(key);
+                if (found == j.end() || !found->is_string())
+                {
+                    return false;
+                }
+            }
+            using SumType = typename OnlineStats<T, std::string>::SumType;
+            stats = OnlineStats<T, std::string>::fromParts(j["Count"].get<uint64_t>(), j["Sum"].get<SumType>(),
+                                                           j["Mean"].get<double>(), j["M2"].get<double>(),
+                                                           j["Min"].get<T>(), j["ArgMin"].get<std::string>(),
+                                                           j["Max"].get<T>(), j["ArgMax"].get<std::string>());
+            return true;
+        }
+    };
+
+    // A pass's series as a shard metric, with its own copy of the names
+    template <typename T>
+    OnlineStats<T, std::string> namedStats(const OnlineStats<T> &stats)
+    {
+        return stats.rename([](llvm::StringRef name)
+        {
+            return name.str();
+        });
+    }
+
+    inline ShardMetric shardMetricOf(const MetricSeries<int> &series, const std::string &countName,
+                                     bool hasSummation, bool hasMinimum, bool hasAverage, bool extended)
+    {
+        ShardMetric metric;
+        metric.countName = countName;
+        metric.hasSummation = hasSummation;
+        metric.hasMinimum = hasMinimum;
+        metric.hasAverage = hasAverage;
+        metric.extended = extended;
+        metric.stats = namedStats(series.stats);
+        metric.top = series.top.rename([](llvm::StringRef name)
+        {
+            return name.str();
+        });
+        metric.sketch = series.sketch;
+        return metric;
+    }
+
+    // {"Format":"backedges-stats-shard","Version":1,"Metrics":[...]}
+    inline void writeShard(llvm::raw_ostream &os, const std::vector<ShardMetric> &metrics)
+    {
+        JsonStreamWriter writer(os);
+        writer.beginObject();
+        writer.field("Format", ShardFormat);
+        writer.field("Version", ShardVersion);
+        writer.key("Metrics");
+        writer.beginArray();
+        for (const ShardMetric &metric : metrics)
+        {
+            metric.write(writer);
+        }
+        writer.endArray();
+        writer.endObject();
+        os << "\n";
+    }
+
+    inline bool readShard(llvm::StringRef text, std::vector<ShardMetric> &metrics, std::string &error)
+    {
+        nlohmann::json j = nlohmann::json::parse(text.begin(), text.end(), nullptr, false);
+        if (j.is_discarded() || !j.is_object())
+        {
+            error = "not JSON";
+            return false;
+        }
+        if (j.value("Format", std::string()) != ShardFormat || j.value("Version", 0u) != ShardVersion)
+        {
+            error = "not a version " + std::to_string(ShardVersion) + " stats shard";
+            return false;
+        }
+        auto list = j.find("Metrics");
+        if (list == j.end() || !list->is_array())
+        {
+            error = "no Metrics array";
+            return false;
+        }
+        for (const nlohmann::json &entry : *list)
+        {
+            ShardMetric metric;
+            if (!ShardMetric::read(entry, metric))
+            {
+                error = "malformed metric";
+                return false;
+            }
+            metrics.push_back(std::move(metric));
+        }
+        return true;
+    }
+}
+
+#endif // BACKEDGES_STATSSHARD_H
@@ -0,0 +1,224 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_STATSWRITER_H
+#define BACKEDGES_STATSWRITER_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <nlohmann/json.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+namespace backedges
+{
+    // Same digits json::dump() printed (Grisu2 shortest round trip, ".0" on integral values,
+    // null for NaN and infinity), formatted into a stack buffer instead of a json value.
+    inline void writeJsonDouble(llvm::raw_ostream &os, double value)
+    {
+        if (!std::isfinite(value))
+        {
+            os << "null";
+            return;
+        }
+        char buffer[64];
+        char *end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), value);
+        os.write(buffer, end - buffer);
+    }
+
+    // same escaping as nlohmann::json, UTF-8 passes through untouched
+    inline void writeJsonString(llvm::raw_ostream &os, llvm::StringRef str)
+    {
+        static const char hexDigits[] = "0123456789abcdef";
+        os << '"';
+        for (unsigned char c : str)
+        {
+            switch (c)
+            {
+                case '"':  os << "\\\""; break;
+                case '\\': os << "\\\\"; break;
+                case '\b': os << "\\b"; break;
+                case '\f': os << "\\f"; break;
+                case '\n': os << "\\n"; break;
+                case '\r': os << "\\r"; break;
+                case '\t': os << "\\t"; break;
+                default:
+                    if (c < 0x20)
+                    {
+                        os << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 0xf];
+                    }
+                    else
+                    {
+                        os << static_cast<char>(c);
+                    }
+            }
+        }
+        os << '"';
+    }
+
+    // Emits JSON straight to a stream without building a document first. indentStep 0 gives
+    // the compact form of json::dump(), 4 gives what std::setw(4) << json printed.
+    // Keys are written in the order they are given; callers that want the old files byte for
+    // byte write them in sorted order like nlohmann's std::map did.
+    class JsonStreamWriter
+    {
+    public:
+        JsonStreamWriter(llvm::raw_ostream &os, unsigned indentStep = 0) : os(os), indentStep(indentStep) {}
+
+        void beginObject()
+        {
+            beginValue();
+            os << '{';
+            scopes.push_back(0);
+        }
+
+        void endObject()
+        {
+            endScope();
+            os << '}';
+        }
+
+        void beginArray()
+        {
+            beginValue();
+            os << '[';
+            scopes.push_back(0);
+        }
+
+        void endArray()
+        {
+            endScope();
+            os << ']';
+        }
+
+        void key(llvm::StringRef name)
+        {
+            nextEntry();
+            writeJsonString(os, name);
+            os << (indentStep != 0 ? ": " : ":");
+            pendingKey = true;
+        }
+
+        void value(int64_t number)
+        {
+            beginValue();
+            os << number;
+        }
+
+        void value(int number)
+        {
+            value(static_cast<int64_t>(number));
+        }
+
+        void value(unsigned number)
+        {
+            value(static_cast<int64_t>(number));
+        }
+
+        void value(uint64_t number)
+        {
+            beginValue();
+            os << number;
+        }
+
+        void value(double number)
+        {
+            beginValue();
+            writeJsonDouble(os, number);
+        }
+
+        void value(llvm::StringRef str)
+        {
+            beginValue();
+            writeJsonString(os, str);
+        }
+
+        void value(const char *str)
+        {
+            value(llvm::StringRef(str));
+        }
+
+        void value(bool flag)
+        {
+            beginValue();
+            os << (flag ? "true" : "false");
+        }
+
+        void null()
+        {
+            beginValue();
+            os << "null";
+        }
+
+        template <typename T>
+        void field(llvm::StringRef name, const T &fieldValue)
+        {
+            key(name);
+            value(fieldValue);
+        }
+
+    private:
+        llvm::raw_ostream &os;
+        unsigned indentStep;
+        llvm::SmallVector<unsigned, 8> scopes; // entries written so far in each open container
+        bool pendingKey = false;
+
+        void newline(unsigned depth)
+        {
+            if (indentStep != 0)
+            {
+                os << '\n';
+                os.indent(depth * indentStep);
+            }
+        }
+
+        void nextEntry()
+        {
+            if (!scopes.empty())
+            {
+                if (scopes.back()++ != 0)
+                {
+                    os << ',';
+                }
+                newline(scopes.size());
+            }
+        }
+
+        // a value either follows its key or is the next element of an array
+        void beginValue()
+        {
+            if (pendingKey)
+            {
+                pendingKey = false;
+                return;
+            }
+            nextEntry();
+        }
+
+        void endScope()
+        {
+            unsigned entries = scopes.pop_back_val();
+            if (entries != 0)
+            {
+                newline(scopes.size());
+            }
+        }
+    };
+}
+
+#endif // BACKEDGES_STATSWRITER_H
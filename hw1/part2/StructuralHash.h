@@ -0,0 +1,293 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_STRUCTURALHASH_H
+#define BACKEDGES_STRUCTURALHASH_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <string>
+
+namespace backedges
+{
+    // A 64 bit hash that comes out the same in every process on every host, unlike
+    // llvm::hash_code, whose seed may change between runs. Good enough to key caches with.
+    class StableHash
+    {
+    public:
+        void add(uint64_t value)
+        {
+            state = mix(state ^ (value + 0x9e3779b97f4a7c15ULL + (state << 6) + (state >> 2)));
+        }
+
+        void add(llvm::StringRef bytes)
+        {
+            // FNV-1a over the bytes, then the length so "ab","c" and "a","bc" differ
+            uint64_t fnv = 0xcbf29ce484222325ULL;
+            for (unsigned char byte : bytes)
+            {
+                fnv = (fnv ^ byte) * 0x100000001b3ULL;
+            }
+            add(fnv);
+            add(bytes.size());
+        }
+
+        uint64_t get() const
+        {
+            return state;
+        }
+
+    private:
+        uint64_t state = 0;
+
+        // the 64 bit murmur3 finalizer
+        static uint64_t mix(uint64_t value)
+        {
+            value ^= value >> 33;
+            value *= 0xff51afd7ed558ccdULL;
+            value ^= value >> 33;
+            value *= 0xc4ceb9fe1a85ec53ULL;
+            value ^= value >> 33;
+            return value;
+        }
+    };
+
+    // Hashes the parts of a function that are not local names: types structurally, through
+    // their printed form, and constants by value, down through constant expressions and
+    // aggregates. Both are remembered for the function, they repeat a lot.
+    class StructuralHasher
+    {
+    public:
+        uint64_t hash(const llvm::Function &F)
+        {
+            self = &F;
+            unsigned next = 0;
+            for (const llvm::BasicBlock &block : F)
+            {
+                position[&block] = next++;
+                for (const llvm::Instruction &inst : block)
+                {
+                    position[&inst] = next++;
+                }
+            }
+
+            StableHash hash;
+            hash.add(typeHash(F.getFunctionType()));
+            hash.add(F.size());
+            for (const llvm::BasicBlock &block : F)
+            {
+                hash.add(block.size());
+                for (const llvm::Instruction &inst : block)
+                {
+                    addInstruction(hash, inst);
+                }
+            }
+            return hash.get();
+        }
+
+    private:
+        const llvm::Function *self = nullptr;
+        llvm::DenseMap<const llvm::Value *, unsigned> position;
+        llvm::DenseMap<const llvm::Type *, uint64_t> types;
+        llvm::DenseMap<const llvm::Constant *, uint64_t> constants;
+
+        uint64_t typeHash(const llvm::Type *type)
+        {
+            auto found = types.find(type);
+            if (found != types.end())
+            {
+                return found->second;
+            }
+            std::string printed;
+            llvm::raw_string_ostream os(printed);
+            type->print(os);
+            StableHash hash;
+            hash.add(llvm::StringRef(os.str()));
+            return types[type] = hash.get();
+        }
+
+        void addInstruction(StableHash &hash, const llvm::Instruction &inst)
+        {
+            hash.add(inst.getOpcode());
+            hash.add(typeHash(inst.getType()));
+            // nsw, nuw, exact, inbounds and the fast math flags
+            hash.add(inst.getRawSubclassOptionalData());
+            hash.add(inst.getNumOperands());
+            if (const llvm::CmpInst *cmp = llvm::dyn_cast<llvm::CmpInst>(&inst))
+            {
+                hash.add(cmp->getPredicate());
+            }
+            else if (const llvm::AllocaInst *alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst))
+            {
+                hash.add(typeHash(alloca->getAllocatedType()));
+            }
+            else if (const llvm::GetElementPtrInst *gep = llvm::dyn_cast<llvm::GetElementPtrInst>(&inst))
+            {
+                hash.add(typeHash(gep->getSourceElementType()));
+            }
+            else if (const llvm::ExtractValueInst *extract = llvm::dyn_cast<llvm::ExtractValueInst>(&inst))
+            {
+                for (unsigned index : extract->indices())
+                {
+                    hash.add(index);
+                }
+            }
+            else if (const llvm::InsertValueInst *insert = llvm::dyn_cast<llvm::InsertValueInst>(&inst))
+            {
+                for (unsigned index : insert->indices())
+                {
+                    hash.add(index);
+                }
+            }
+            else if (const llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(&inst))
+            {
+                // the incoming blocks are not operands, which value comes from where is
+                for (const llvm::BasicBlock *block : phi->blocks())
+                {
+                    hash.add(position.lookup(block));
+                }
+            }
+            for (const llvm::Value *operand : inst.operands())
+            {
+                addOperand(hash, operand);
+            }
+        }
+
+        void addOperand(StableHash &hash, const llvm::Value *operand)
+        {
+            if (const llvm::Argument *arg = llvm::dyn_cast<llvm::Argument>(operand))
+            {
+                hash.add(1);
+                hash.add(arg->getArgNo());
+            }
+            else if (llvm::isa<llvm::BasicBlock>(operand) || llvm::isa<llvm::Instruction>(operand))
+            {
+                hash.add(2);
+                hash.add(position.lookup(operand));
+            }
+            else if (const llvm::Constant *constant = llvm::dyn_cast<llvm::Constant>(operand))
+            {
+                hash.add(3);
+                hash.add(constantHash(constant));
+            }
+            else if (const llvm::InlineAsm *inlineAsm = llvm::dyn_cast<llvm::InlineAsm>(operand))
+            {
+                hash.add(4);
+                hash.add(typeHash(inlineAsm->getFunctionType()));
+                hash.add(llvm::StringRef(inlineAsm->getAsmString()));
+                hash.add(llvm::StringRef(inlineAsm->getConstraintString()));
+                hash.add(inlineAsm->hasSideEffects());
+            }
+            else
+            {
+                // metadata operands by kind and type
+                hash.add(5);
+                hash.add(operand->getValueID());
+                hash.add(typeHash(operand->getType()));
+            }
+        }
+
+        // globals by name, the function itself by a tag so recursion does not bring its name in,
+        // numbers by their bits, everything else by kind, type and operands
+        uint64_t constantHash(const llvm::Constant *constant)
+        {
+            auto found = constants.find(constant);
+            if (found != constants.end())
+            {
+                return found->second;
+            }
+            StableHash hash;
+            hash.add(constant->getValueID());
+            hash.add(typeHash(constant->getType()));
+            if (constant == self)
+            {
+                hash.add(0);
+            }
+            else if (const llvm::GlobalValue *global = llvm::dyn_cast<llvm::GlobalValue>(constant))
+            {
+                hash.add(global->getName());
+            }
+            else if (const llvm::ConstantInt *integer = llvm::dyn_cast<llvm::ConstantInt>(constant))
+            {
+                addBits(hash, integer->getValue());
+            }
+            else if (const llvm::ConstantFP *real = llvm::dyn_cast<llvm::ConstantFP>(constant))
+            {
+                addBits(hash, real->getValueAPF().bitcastToAPInt());
+            }
+            else if (const llvm::ConstantDataSequential *data = llvm::dyn_cast<llvm::ConstantDataSequential>(constant))
+            {
+                hash.add(data->getRawDataValues());
+            }
+            else
+            {
+                if (const llvm::ConstantExpr *expr = llvm::dyn_cast<llvm::ConstantExpr>(constant))
+                {
+                    hash.add(expr->getOpcode());
+                    hash.add(expr->getRawSubclassOptionalData());
+                    if (expr->isCompare())
+                    {
+                        hash.add(expr->getPredicate());
+                    }
+                }
+                // aggregates, constant expressions and block addresses
+                hash.add(constant->getNumOperands());
+                for (const llvm::Value *operand : constant->operands())
+                {
+                    if (const llvm::Constant *nested = llvm::dyn_cast<llvm::Constant>(operand))
+                    {
+                        hash.add(constantHash(nested));
+                    }
+                    else
+                    {
+                        hash.add(position.lookup(operand));
+                    }
+                }
+            }
+            return constants[constant] = hash.get();
+        }
+
+        static void addBits(StableHash &hash, const llvm::APInt &value)
+        {
+            hash.add(value.getBitWidth());
+            for (unsigned word = 0; word < value.getNumWords(); word++)
+            {
+                hash.add(value.getRawData()[word]);
+            }
+        }
+    };
+
+    // The structural hash of a function: its signature, then its blocks in layout order with
+    // every instruction's opcode, type, flags and operands. Blocks, arguments and instructions
+    // are hashed by position, so renaming locals or the function itself leaves the hash alone;
+    // constants are hashed by value, globals and callees by name, types by structure. A
+    // recursive call names the function too, so references to itself are hashed by a tag.
+    // The CFG is in there through the terminators' block operands. A declaration hashes to
+    // its signature only.
+    inline uint64_t structuralHash(const llvm::Function &F)
+    {
+        return StructuralHasher().hash(F);
+    }
+}
+
+#endif // BACKEDGES_STRUCTURALHASH_H
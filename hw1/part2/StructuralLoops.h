@@ -0,0 +1,202 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_STRUCTURALLOOPS_H
+#define BACKEDGES_STRUCTURALLOOPS_H
+
+#include "CFGIndex.h"
+
+#include <vector>
+
+namespace backedges
+{
+    // Loop metrics derived from the CFG alone, no DominatorTree or LoopInfo. On a reducible
+    // CFG the DFS back edges are exactly the dominator back edges and the headers found below
+    // are the LoopInfo headers, so the counts are exact. On an irreducible CFG they depend on
+    // the DFS order and only approximate what LoopInfo would report.
+    struct StructuralSummary
+    {
+        unsigned numTreeEdges = 0;
+        unsigned numForwardEdges = 0;
+        unsigned numBackEdges = 0;     // self loops included
+        unsigned numCrossEdges = 0;
+        bool reducible = true;
+        std::vector<unsigned> headers; // loop header candidates, block indices in reverse preorder
+        unsigned numTopLevelLoops = 0;
+
+        unsigned numLoops() const
+        {
+            return headers.size();
+        }
+    };
+
+    inline StructuralSummary computeStructuralSummary(const CSRGraph &graph)
+    {
+        StructuralSummary summary;
+        const unsigned n = graph.numNodes;
+        if (n == 0)
+        {
+            return summary;
+        }
+
+        // One iterative DFS numbers the nodes and classifies every edge as it is explored:
+        // an unvisited target is a tree edge, a target still on the stack closes a cycle,
+        // a finished target is forward if it was discovered after the source, cross otherwise.
+        std::vector<unsigned> preNum(n, NoNode);
+        std::vector<unsigned> postNum(n, NoNode);
+        std::vector<unsigned> preorder;
+        preorder.reserve(n);
+        std::vector<std::pair<unsigned, unsigned>> stack;
+        preNum[0] = 0;
+        preorder.push_back(0);
+        stack.push_back(std::make_pair(0u, 0u));
+        unsigned postCounter = 0;
+        while (!stack.empty())
+        {
+            unsigned node = stack.back().first;
+            llvm::ArrayRef<unsigned> succList = graph.successors(node);
+            if (stack.back().second < succList.size())
+            {
+                unsigned succ = succList[stack.back().second++];
+                if (preNum[succ] == NoNode)
+                {
+                    summary.numTreeEdges++;
+                    preNum[succ] = preorder.size();
+                    preorder.push_back(succ);
+                    stack.push_back(std::make_pair(succ, 0u));
+                }
+                else if (postNum[succ] == NoNode)
+                {
+                    summary.numBackEdges++;
+                }
+                else if (preNum[node] < preNum[succ])
+                {
+                    summary.numForwardEdges++;
+                }
+                else
+                {
+                    summary.numCrossEdges++;
+                }
+            }
+            else
+            {
+                postNum[node] = postCounter++;
+                stack.pop_back();
+            }
+        }
+
+        auto isAncestor = [&](unsigned u, unsigned v)
+        {
+            return preNum[u] <= preNum[v] && postNum[v] <= postNum[u];
+        };
+
+        // Havlak's loop nesting with union-find: visit candidate headers innermost first
+        // (reverse preorder) and collapse each loop body into its header. A body node entered
+        // from outside the header's DFS subtree means the header does not dominate its loop.
+        std::vector<unsigned> unionParent(n);
+        for (unsigned node = 0; node < n; node++)
+        {
+            unionParent[node] = node;
+        }
+        auto find = [&](unsigned node)
+        {
+            unsigned root = node;
+            while (unionParent[root] != root)
+            {
+                root = unionParent[root];
+            }
+            while (unionParent[node] != root)
+            {
+                unsigned next = unionParent[node];
+                unionParent[node] = root;
+                node = next;
+            }
+            return root;
+        };
+
+        std::vector<unsigned> enclosingHeader(n, NoNode);
+        std::vector<unsigned> poolStamp(n, NoNode);
+        std::vector<unsigned> pool;
+        std::vector<unsigned> worklist;
+        for (unsigned num = preorder.size(); num-- > 0;)
+        {
+            unsigned header = preorder[num];
+            bool isHeader = false;
+            pool.clear();
+            for (unsigned pred : graph.predecessors(header))
+            {
+                if (preNum[pred] == NoNode || !isAncestor(header, pred))
+                {
+                    continue;
+                }
+                isHeader = true;
+                unsigned rep = find(pred);
+                if (rep != header && poolStamp[rep] != header)
+                {
+                    poolStamp[rep] = header;
+                    pool.push_back(rep);
+                }
+            }
+
+            worklist.assign(pool.begin(), pool.end());
+            while (!worklist.empty())
+            {
+                unsigned body = worklist.back();
+                worklist.pop_back();
+                for (unsigned pred : graph.predecessors(body))
+                {
+                    // unreachable predecessors and back edges into an inner header do not count
+                    if (preNum[pred] == NoNode || isAncestor(body, pred))
+                    {
+                        continue;
+                    }
+                    unsigned rep = find(pred);
+                    if (!isAncestor(header, rep))
+                    {
+                        summary.reducible = false;
+                        continue;
+                    }
+                    if (rep != header && poolStamp[rep] != header)
+                    {
+                        poolStamp[rep] = header;
+                        pool.push_back(rep);
+                        worklist.push_back(rep);
+                    }
+                }
+            }
+
+            if (isHeader)
+            {
+                summary.headers.push_back(header);
+                for (unsigned body : pool)
+                {
+                    enclosingHeader[body] = header;
+                    unionParent[body] = header;
+                }
+            }
+        }
+
+        for (unsigned header : summary.headers)
+        {
+            if (enclosingHeader[header] == NoNode)
+            {
+                summary.numTopLevelLoops++;
+            }
+        }
+        return summary;
+    }
+}
+
+#endif // BACKEDGES_STRUCTURALLOOPS_H
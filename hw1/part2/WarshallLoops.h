@@ -0,0 +1,427 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_WARSHALLLOOPS_H
+#define BACKEDGES_WARSHALLLOOPS_H
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace backedges
+{
+    typedef std::map<const llvm::BasicBlock *, std::map<const llvm::BasicBlock *, int> > matBasicBlocks;
+    typedef std::map<const llvm::BasicBlock *, std::map<const llvm::BasicBlock *, const llvm::BasicBlock *> > matSucBasicBlocks;
+    typedef std::vector<const llvm::BasicBlock *> basicBlockPath;
+
+    // The cycle based loop detector behind -warshloopdetector: Floyd-Warshall over the CFG,
+    // then every cycle is counted once per entry point, so a multi-entry cycle counts as
+    // several loops. Lives outside the pass so the loop detector benchmark can time it too.
+    // With verbose off nothing is printed, the matrices are not even formatted.
+    class WarshallLoopDetector
+    {
+    public:
+        const int infinity = SHRT_MAX;
+        const int minValue = 1;
+        
+        WarshallLoopDetector(const llvm::DominatorTree &domTree, llvm::raw_ostream &out, bool verbose)
+            : domTree(domTree), out(out), verbose(verbose) {}
+        
+        int countLoops(const llvm::Function &func)
+        {
+            matBasicBlocks dist;
+            matSucBasicBlocks next;
+            warhsalAlgo(func, dist, next);
+            return pathReconstruction(func, dist, next);
+        }
+        
+        void printMap(matBasicBlocks &aMap)
+        {
+            for (auto& t : aMap)
+            {
+                for (auto& tt : t.second)
+                {
+                    if(tt.second == SHRT_MAX)
+                        out << "INF ";
+                    else
+                        out << " " << tt.second << "  ";
+                }
+                out << "\n";
+            }
+        }
+        
+        void printMap(matSucBasicBlocks &aMap)
+        {
+            
+            for (auto& t : aMap)
+            {
+                (t.first)->printAsOperand(out, false);
+                out << ": ";
+                for (auto& tt : t.second)
+                {
+                    if(tt.second == nullptr)
+                    {
+                        out << "NULL ";
+                    }
+                    else
+                    {
+                        out << " ";
+                        (tt.second)->printAsOperand(out, false);
+                        out << "  ";
+                    }
+                }
+                out << "\n";
+            }
+        }
+        void printMapPointer(matSucBasicBlocks &aMap)
+        {
+            for (auto& t : aMap)
+            {
+                for (auto& tt : t.second)
+                {
+                    if(tt.second == nullptr)
+                    {
+                        out << "nullptr        ";
+                    }
+                    else
+                    {
+                       out << tt.second << "  ";
+                    }
+                }
+                out << "\n";
+            }
+        }
+        
+        void printVector(basicBlockPath &avector)
+        {
+            out << "[";
+            for (auto v = avector.begin(); v != avector.end(); ++v)
+            {
+                (*v)->printAsOperand(out, false);
+                out << " ";
+            }
+            out << "]\n";
+        }
+        /*
+         https://en.wikipedia.org/wiki/Floyd%E2%80%93Warshall_algorithm#Path_reconstruction
+        procedure Path(u, v)
+            if next[u][v] = null then
+                return []
+            path = [u]
+            while u ≠ v
+                u ← next[u][v]
+                path.append(u)
+            return path
+        */
+        basicBlockPath Path(const llvm::BasicBlock *u, const llvm::BasicBlock *v, matSucBasicBlocks &next)
+        {
+            if(next[u][v] == nullptr)
+            {
+                return basicBlockPath();
+            }
+            basicBlockPath path;
+            path.push_back(u);
+            const llvm::BasicBlock *u_inc = u;
+            while(u_inc != v)
+            {
+                u_inc = next[u_inc][v];
+                path.push_back(u_inc);
+            }
+            return path;
+        }
+        
+        basicBlockPath mergePaths(const basicBlockPath &vuPath,const basicBlockPath &uvPath)
+        {
+            basicBlockPath concatPath;
+            if(vuPath.size() > 0)
+            {
+                concatPath.insert(concatPath.end(), vuPath.begin(), vuPath.end());
+            }
+            if(vuPath.size() > 0)
+            {
+                if(concatPath.back() == uvPath.front())
+                {
+                    concatPath.pop_back();
+                }
+                
+                concatPath.insert(concatPath.end(), uvPath.begin(), uvPath.end());
+            }
+            return concatPath;
+        }
+        
+        std::string getPathHash(const basicBlockPath &path)
+        {
+            std::stringstream ss;
+            for (auto v = path.begin(); v != path.end(); ++v)
+            {
+                 ss << *v << " ";
+            }
+            return ss.str();
+        }
+        
+        int LoopCounter(const llvm::Function &func, basicBlockPath &path, std::map<std::string,bool> &seenPathsPred)
+        {
+            int iLoopCounter = 0;
+            for (auto node = path.begin(); node != path.end(); ++node)
+            {
+                const llvm::BasicBlock* searchNode = *node;
+                for (llvm::Function::const_iterator iter = func.begin(); iter != func.end(); ++iter)
+                {
+                    const llvm::BasicBlock &currBlock = *iter;
+                    if(std::find(path.begin(), path.end(), &currBlock) == path.end())
+                    {
+                        const llvm::TerminatorInst *termInst = currBlock.getTerminator();
+                        for (unsigned int v_succIndex = 0; v_succIndex < termInst->getNumSuccessors(); v_succIndex++)
+                        {
+                             const llvm::BasicBlock *v_succ = termInst->getSuccessor(v_succIndex);
+                            if(v_succ == searchNode)
+                            {
+                                if (!domTree.dominates(searchNode, &currBlock))
+                                {
+                                    basicBlockPath predList;
+                                    predList.push_back(&currBlock);
+                                    predList.push_back(searchNode);
+                                    std::string predListHash = getPathHash(predList);
+                                    //out << "\npath: " << predListHash << "\n";
+                                    
+                                    if(seenPathsPred.find(predListHash) == seenPathsPred.end())
+                                    {
+                                        if (verbose)
+                                        {
+                                            out << "PredList added:\n [";
+                                            currBlock.printAsOperand(out, false);
+                                            out << " ";
+                                            searchNode->printAsOperand(out, false);
+                                            out << " ]\n";
+                                        }
+                                        seenPathsPred[predListHash] = true;
+                                        iLoopCounter++;
+                                        break;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            return iLoopCounter;
+        }
+        
+        bool areVectorsPermutations(basicBlockPath & path1, basicBlockPath & path2)
+        {
+            if(path1.size() != path2.size())
+            {
+                return false;
+            }
+            for(size_t i = 0; i < path1.size(); i++)
+            {
+                bool bExists = false;
+                for(size_t j = 0; j < path2.size(); j++)
+                {
+                    if(path1[i] == path2[j])
+                    {
+                        bExists =  true;
+                        break;
+                    }
+                }
+                if (bExists == false)
+                {
+                    return false;
+                }
+            }
+            
+            return true;
+        }
+        
+        int pathReconstruction(const llvm::Function &func, matBasicBlocks &dist, matSucBasicBlocks &next)
+        {
+            int iLoopCounter = 0;
+            std::map<std::string,bool> seenPathCombos;
+            std::map<std::string,bool> seenPathsPred;
+            std::vector<basicBlockPath> seenPaths;
+            for (llvm::Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
+            {
+                const llvm::BasicBlock *v_Block = &*v_iter;
+                for (llvm::Function::const_iterator u_iter = func.begin(); u_iter != func.end(); ++u_iter)
+                {
+                    const llvm::BasicBlock *u_Block = &*u_iter;
+                    
+                    if (dist[v_Block][u_Block] == infinity || //skip non-weighted path
+                        dist[u_Block][v_Block] == infinity ||
+                        dist[v_Block][u_Block] == 0        || // skip [v][v]
+                        dist[u_Block][v_Block] == 0)
+                    {
+                        continue;
+                    }
+                    basicBlockPath vuPath = Path(v_Block, u_Block, next);
+                    basicBlockPath uvPath = Path(u_Block, v_Block, next);
+                    basicBlockPath path = mergePaths(vuPath, uvPath);
+                    std::string pathHash = getPathHash(path);
+                    
+                    //out << "\npath before edit:\n";
+                    //printVector(path);
+                    if(seenPathCombos.find(pathHash) == seenPathCombos.end())
+                    {
+                        seenPathCombos[pathHash] = true;
+                        
+                        if(path.front() == path.back())
+                        {
+                            
+                            path.pop_back(); // we found a cycle make it a-cyclic
+                            bool addToSeenPaths = true;
+                            for (auto seenPathIter = seenPaths.begin(); seenPathIter != seenPaths.end(); ++seenPathIter)
+                            {
+                                basicBlockPath seenPath =*seenPathIter;
+                                if(areVectorsPermutations(seenPath,path))
+                                {
+                                    addToSeenPaths = false;
+                                }
+                                
+                            }
+                            if(addToSeenPaths)
+                            {
+                                if (verbose)
+                                {
+                                    out << "\nnew path found:\n";
+                                    printVector(path);
+                                }
+                                seenPaths.push_back(path);
+                                iLoopCounter += LoopCounter(func, path, seenPathsPred);
+                            }
+                        }
+                        else if (verbose)
+                        {
+                            out << "path does not have a cycle exiting loop";
+                        }
+                        
+                    }
+                }
+            }
+            //out << "Loop Count: " << iLoopCounter << "\n";
+            return iLoopCounter;
+        }
+        
+        void warhsalAlgo(const llvm::Function &func, matBasicBlocks &dist, matSucBasicBlocks &next)
+        {
+            /*
+             https://en.wikipedia.org/wiki/Floyd%E2%80%93Warshall_algorithm
+             1 let dist be a |V| × |V| array of minimum distances initialized to ∞ (infinity)
+             2 for each vertex v
+             3    dist[v][v] ← 0
+             4 for each edge (u,v)
+             5    dist[u][v] ← w(u,v)  // the weight of the edge (u,v)
+             6 for k from 1 to |V|
+             7    for i from 1 to |V|
+             8       for j from 1 to |V|
+             9          if dist[i][j] > dist[i][k] + dist[k][j]
+             10             dist[i][j] ← dist[i][k] + dist[k][j]
+             11         end if
+             */
+            
+            
+            // initialized dist to ∞ (infinity)
+            for (llvm::Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
+            {
+                const llvm::BasicBlock *v_Block = &*v_iter;
+                for (llvm::Function::const_iterator u_iter = func.begin(); u_iter != func.end(); ++u_iter)
+                {
+                    const llvm::BasicBlock *u_Block = &*u_iter;
+                    dist[v_Block][u_Block] = infinity;
+                    
+                    // note: for path recon
+                    //let next be a |V| × |V| array of vertex indices initialized to null
+                    next[v_Block][u_Block] = nullptr;
+                }
+            }
+            //out << "init to int max: \n";
+            //printMap(dist);
+            
+            //4-5
+            for (llvm::Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
+            {
+                const llvm::BasicBlock *v_Block = &*v_iter;
+                const llvm::TerminatorInst *termInst = v_Block->getTerminator();
+                for (unsigned int v_succIndex = 0; v_succIndex < termInst->getNumSuccessors(); v_succIndex++)
+                {
+                    const llvm::BasicBlock *v_succ = termInst->getSuccessor(v_succIndex);
+                    dist[v_Block][v_succ] = minValue;
+                    
+                    //  note: path Recon next[u][v] ← v
+                    next[v_Block][v_succ] = v_succ;
+                }
+            }
+            
+            //out << "add min path weights:\n";
+            //printMap(dist);
+            
+            //line 2-3
+            for (llvm::Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
+            {
+                const llvm::BasicBlock *v_Block = &*v_iter;
+                dist[v_Block][v_Block] = 0;
+            }
+            
+            //out << "0 out [v][v]:\n";
+            //printMap(dist);
+            
+            //line 6-11
+            for (llvm::Function::const_iterator k_iter = func.begin(); k_iter != func.end(); ++k_iter)
+            {
+                const llvm::BasicBlock *k_Block = &*k_iter;
+                for (llvm::Function::const_iterator i_iter = func.begin(); i_iter != func.end(); ++i_iter)
+                {
+                    const llvm::BasicBlock *i_Block = &*i_iter;
+                    for (llvm::Function::const_iterator j_iter = func.begin(); j_iter != func.end(); ++j_iter)
+                    {
+                        const llvm::BasicBlock *j_Block = &*j_iter;
+                        if (dist[i_Block][j_Block] > dist[i_Block][k_Block] + dist[k_Block][j_Block])
+                        {
+                            dist[i_Block][j_Block] = dist[i_Block][k_Block] + dist[k_Block][j_Block];
+                            
+                            // note: path Recon next[i][j] ← next[i][k]
+                            next[i_Block][j_Block] = next[i_Block][k_Block];
+                            
+                        }
+                    }
+                }
+            }
+            if (verbose)
+            {
+                out << "Warshall graph:\n";
+                printMap(dist);
+                
+                out << "Warshall next graph:\n";
+                printMap(next);
+            }
+            //out << "Warshall next graph pointers:\n";
+            //printMapPointer(next);
+        }
+        
+    private:
+        const llvm::DominatorTree &domTree;
+        llvm::raw_ostream &out;
+        bool verbose;
+    };
+}
+
+#endif // BACKEDGES_WARSHALLLOOPS_H
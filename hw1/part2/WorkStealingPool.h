@@ -0,0 +1,131 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+#ifndef BACKEDGES_WORKSTEALINGPOOL_H
+#define BACKEDGES_WORKSTEALINGPOOL_H
+
+#include "CacheLineArray.h"
+
+#include "llvm/ADT/STLExtras.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace backedges
+{
+    // Runs a fixed list of tasks on a set of threads. The tasks come in priority order,
+    // biggest first, and are dealt round robin onto one deque per worker, so every worker
+    // starts on one of the biggest. A worker takes from the front of its own deque; once it
+    // is empty it steals from the front of the others', the biggest task they have left, so
+    // no big task is left to start last and hold up the end of the run.
+    class WorkStealingPool
+    {
+    public:
+        explicit WorkStealingPool(unsigned numWorkers)
+            : numWorkers(std::max(1u, numWorkers)), queues(this->numWorkers) {}
+
+        WorkStealingPool(const WorkStealingPool &) = delete;
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+        unsigned size() const
+        {
+            return numWorkers;
+        }
+
+        // body(worker, task) for every task in [0, numTasks), returns when all are done.
+        // The calling thread is worker 0.
+        void run(size_t numTasks, llvm::function_ref<void(unsigned, size_t)> body)
+        {
+            for (size_t task = 0; task < numTasks; task++)
+            {
+                queues[task % numWorkers].tasks.push_back(task);
+            }
+            steals.store(0, std::memory_order_relaxed);
+            std::vector<std::thread> threads;
+            for (unsigned worker = 1; worker < numWorkers; worker++)
+            {
+                threads.emplace_back([this, worker, body]() { work(worker, body); });
+            }
+            work(0, body);
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        // tasks that ran on a worker other than the one they were dealt to, in the last run
+        size_t numSteals() const
+        {
+            return steals.load(std::memory_order_relaxed);
+        }
+
+    private:
+        // a cache line each, so workers taking from their own deques do not share one
+        struct Queue
+        {
+            std::mutex lock;
+            std::deque<size_t> tasks;
+        };
+
+        const unsigned numWorkers;
+        CacheLineArray<Queue> queues;
+        std::atomic<size_t> steals{0};
+
+        bool take(unsigned from, size_t &task)
+        {
+            Queue &queue = queues[from];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.tasks.empty())
+            {
+                return false;
+            }
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+
+        // nothing adds tasks during a run, so a full round of empty deques means done
+        void work(unsigned worker, llvm::function_ref<void(unsigned, size_t)> body)
+        {
+            size_t task;
+            for (;;)
+            {
+                if (take(worker, task))
+                {
+                    body(worker, task);
+                    continue;
+                }
+                bool stole = false;
+                for (unsigned offset = 1; offset < numWorkers && !stole; offset++)
+                {
+                    stole = take((worker + offset) % numWorkers, task);
+                }
+                if (!stole)
+                {
+                    return;
+                }
+                steals.fetch_add(1, std::memory_order_relaxed);
+                body(worker, task);
+            }
+        }
+    };
+}
+
+#endif // BACKEDGES_WORKSTEALINGPOOL_H
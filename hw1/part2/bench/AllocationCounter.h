@@ -0,0 +1,151 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+// Replaces the global operator new/delete so a benchmark can report the heap bytes an
+// algorithm holds at its peak, including what LLVM allocates on its behalf.
+// Include from exactly one translation unit of the executable.
+
+#ifndef BACKEDGES_ALLOCATIONCOUNTER_H
+#define BACKEDGES_ALLOCATIONCOUNTER_H
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace backedges
+{
+    struct AllocationCounter
+    {
+        static std::atomic<size_t> &current()
+        {
+            static std::atomic<size_t> bytes(0);
+            return bytes;
+        }
+
+        static std::atomic<size_t> &peak()
+        {
+            static std::atomic<size_t> bytes(0);
+            return bytes;
+        }
+
+        // start a measurement, the peak is tracked relative to what is live right now
+        static size_t resetPeak()
+        {
+            size_t live = current().load();
+            peak().store(live);
+            return live;
+        }
+
+        static void add(size_t size)
+        {
+            size_t now = current().fetch_add(size) + size;
+            size_t seen = peak().load();
+            while (now > seen && !peak().compare_exchange_weak(seen, now))
+            {
+            }
+        }
+
+        static void remove(size_t size)
+        {
+            current().fetch_sub(size);
+        }
+    };
+
+    // every block carries its size in a header padded to the max fundamental alignment
+    const size_t AllocationHeader = alignof(std::max_align_t);
+
+    inline void *countedAlloc(size_t size)
+    {
+        char *raw = static_cast<char *>(std::malloc(size + AllocationHeader));
+        if (raw == nullptr)
+        {
+            return nullptr;
+        }
+        *reinterpret_cast<size_t *>(raw) = size;
+        AllocationCounter::add(size);
+        return raw + AllocationHeader;
+    }
+
+    inline void countedFree(void *ptr)
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+        char *raw = static_cast<char *>(ptr) - AllocationHeader;
+        AllocationCounter::remove(*reinterpret_cast<size_t *>(raw));
+        std::free(raw);
+    }
+}
+
+void *operator new(size_t size)
+{
+    void *ptr = backedges::countedAlloc(size);
+    if (ptr == nullptr)
+    {
+        llvm::report_bad_alloc_error("benchmark allocation failed");
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return backedges::countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return backedges::countedAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    backedges::countedFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    backedges::countedFree(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    backedges::countedFree(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    backedges::countedFree(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    backedges::countedFree(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    backedges::countedFree(ptr);
+}
+
+#endif // BACKEDGES_ALLOCATIONCOUNTER_H
@@ -0,0 +1,242 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+// Times every dominator engine behind -dom-engine on synthetic CFGs of several shapes and
+// sizes and reports build time and peak heap use per engine as CSV:
+//   shape,blocks,edges,engine,min_us,median_us,peak_bytes,agrees
+// "agrees" checks the engine's immediate dominators against LLVM's Semi-NCA tree.
+
+#include "AllocationCounter.h"
+#include "DominatorEngines.h"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace backedges;
+
+static cl::list<unsigned> Sizes("sizes", cl::desc("Block counts to generate"), cl::CommaSeparated);
+static cl::opt<unsigned> Repetitions("reps", cl::desc("Timed builds per engine"), cl::init(5));
+static cl::opt<unsigned> Seed("seed", cl::desc("Seed for the random shapes"), cl::init(6241));
+
+namespace
+{
+    typedef std::vector<std::vector<unsigned>> Adjacency;
+
+    void addEdge(Adjacency &adj, unsigned from, unsigned to)
+    {
+        if (to < adj.size())
+        {
+            adj[from].push_back(to);
+        }
+    }
+
+    // straight line code
+    Adjacency makeChain(unsigned n)
+    {
+        Adjacency adj(n);
+        for (unsigned i = 0; i + 1 < n; i++)
+        {
+            addEdge(adj, i, i + 1);
+        }
+        return adj;
+    }
+
+    // a ladder of if/else diamonds
+    Adjacency makeDiamonds(unsigned n)
+    {
+        Adjacency adj(n);
+        for (unsigned head = 0; head < n; head += 3)
+        {
+            addEdge(adj, head, head + 1);
+            addEdge(adj, head, head + 2);
+            addEdge(adj, head + 1, head + 3);
+            addEdge(adj, head + 2, head + 3);
+        }
+        return adj;
+    }
+
+    // n/2 perfectly nested loops, header k is closed by the latch n-1-k
+    Adjacency makeNestedLoops(unsigned n)
+    {
+        Adjacency adj = makeChain(n);
+        for (unsigned k = 1; k < n / 2; k++)
+        {
+            addEdge(adj, n - 1 - k, k);
+        }
+        return adj;
+    }
+
+    // wide switches jumping up to eight blocks ahead
+    Adjacency makeSwitchFan(unsigned n)
+    {
+        Adjacency adj(n);
+        for (unsigned i = 0; i < n; i++)
+        {
+            for (unsigned k = 1; k <= 8; k++)
+            {
+                addEdge(adj, i, i + k);
+            }
+        }
+        return adj;
+    }
+
+    // a spine keeps everything reachable, the random extra edges make it irreducible
+    Adjacency makeRandom(unsigned n)
+    {
+        std::mt19937 rng(Seed + n);
+        Adjacency adj = makeChain(n);
+        // never branch back to the entry block, the verifier rejects that
+        std::uniform_int_distribution<unsigned> pick(1, n - 1);
+        for (unsigned i = 0; i + 1 < n; i++)
+        {
+            if (rng() % 2 == 0)
+            {
+                addEdge(adj, i, pick(rng));
+            }
+        }
+        return adj;
+    }
+
+    // turns an adjacency list into real IR so LLVM's tree can be built from it too
+    Function *materialize(Module &M, const std::string &name, const Adjacency &adj)
+    {
+        LLVMContext &context = M.getContext();
+        Type *i1Ty = Type::getInt1Ty(context);
+        Type *i32Ty = Type::getInt32Ty(context);
+        FunctionType *funcTy = FunctionType::get(i32Ty, {i1Ty, i32Ty}, false);
+        Function *func = Function::Create(funcTy, Function::ExternalLinkage, name, &M);
+        Argument *cond = &*func->arg_begin();
+        Argument *selector = &*std::next(func->arg_begin());
+
+        std::vector<BasicBlock *> blocks;
+        for (unsigned i = 0; i < adj.size(); i++)
+        {
+            blocks.push_back(BasicBlock::Create(context, "b" + std::to_string(i), func));
+        }
+        IRBuilder<> builder(context);
+        for (unsigned i = 0; i < adj.size(); i++)
+        {
+            builder.SetInsertPoint(blocks[i]);
+            const std::vector<unsigned> &succs = adj[i];
+            if (succs.empty())
+            {
+                builder.CreateRet(ConstantInt::get(i32Ty, 0));
+            }
+            else if (succs.size() == 1)
+            {
+                builder.CreateBr(blocks[succs[0]]);
+            }
+            else if (succs.size() == 2)
+            {
+                builder.CreateCondBr(cond, blocks[succs[0]], blocks[succs[1]]);
+            }
+            else
+            {
+                SwitchInst *switchInst = builder.CreateSwitch(selector, blocks[succs[0]], succs.size() - 1);
+                for (unsigned k = 1; k < succs.size(); k++)
+                {
+                    switchInst->addCase(ConstantInt::get(cast<IntegerType>(i32Ty), k), blocks[succs[k]]);
+                }
+            }
+        }
+        return func;
+    }
+
+    struct Measurement
+    {
+        double minMicros = 0;
+        double medianMicros = 0;
+        size_t peakBytes = 0;
+        bool agrees = true;
+    };
+
+    Measurement measure(const IndexedCFG &cfg, DomEngineKind kind, const DomTreeView &reference)
+    {
+        Measurement result;
+        size_t before = AllocationCounter::resetPeak();
+        {
+            DomTreeView view = buildDominators(cfg, kind);
+            result.peakBytes = AllocationCounter::peak().load() - before;
+            result.agrees = view.idom == reference.idom;
+        }
+
+        std::vector<double> times;
+        for (unsigned rep = 0; rep < std::max(1u, unsigned(Repetitions)); rep++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            DomTreeView view = buildDominators(cfg, kind);
+            auto stop = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        result.minMicros = times.front();
+        result.medianMicros = times[times.size() / 2];
+        return result;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "dominator engine benchmark\n");
+
+    std::vector<unsigned> sizes(Sizes.begin(), Sizes.end());
+    if (sizes.empty())
+    {
+        sizes = {64, 1024, 16384};
+    }
+
+    typedef Adjacency (*ShapeFn)(unsigned);
+    const std::vector<std::pair<const char *, ShapeFn>> shapes = {
+        {"chain", makeChain},
+        {"diamonds", makeDiamonds},
+        {"nested", makeNestedLoops},
+        {"switchfan", makeSwitchFan},
+        {"random", makeRandom},
+    };
+    const DomEngineKind engines[] = {DomEngineKind::CooperHarveyKennedy, DomEngineKind::LengauerTarjan,
+                                     DomEngineKind::SemiNCA};
+
+    LLVMContext context;
+    outs() << "shape,blocks,edges,engine,min_us,median_us,peak_bytes,agrees\n";
+    for (const auto &shape : shapes)
+    {
+        for (unsigned size : sizes)
+        {
+            Module M(shape.first, context);
+            Function *func = materialize(M, shape.first, shape.second(std::max(2u, size)));
+            IndexedCFG cfg(*func);
+            DomTreeView reference = buildDominators(cfg, DomEngineKind::SemiNCA);
+            for (DomEngineKind kind : engines)
+            {
+                Measurement m = measure(cfg, kind, reference);
+                outs() << shape.first << "," << cfg.size() << "," << cfg.graph.numEdges() << ","
+                       << domEngineName(kind) << "," << format("%.1f", m.minMicros) << "," << format("%.1f", m.medianMicros) << ","
+                       << m.peakBytes << "," << (m.agrees ? "yes" : "no") << "\n";
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+// Part 2 and 3 of 3.2 without eyeballing -time-passes: runs the dominator based loop detector
+// (DominatorTree + LoopInfo), the Warshall cycle detector and the fast structural tier over
+// every defined function of a bitcode corpus. Per function it reports wall time, peak heap
+// bytes and loop counts as CSV or JSON lines; the loops Warshall finds beyond the dominator
+// detector are the extra entries of multi-entry cycles. Speedup tables go to stderr.
+//
+//   loopbench [-format=csv|json] [-reps=N] [-warshall-max-blocks=N] a.bc b.bc @corpus.txt
+
+#include "AllocationCounter.h"
+#include "LoopStats.h"
+#include "StructuralLoops.h"
+#include "WarshallLoops.h"
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+using namespace llvm;
+using namespace backedges;
+
+enum class OutputFormat
+{
+    CSV,
+    JSON
+};
+
+static cl::list<std::string> InputFiles(cl::Positional, cl::desc("<bitcode files>"), cl::OneOrMore);
+static cl::opt<OutputFormat> Format("format", cl::desc("Per function output format"),
+    cl::values(clEnumValN(OutputFormat::CSV, "csv", "comma separated rows"),
+               clEnumValN(OutputFormat::JSON, "json", "one JSON object per line")),
+    cl::init(OutputFormat::CSV));
+static cl::opt<unsigned> Repetitions("reps", cl::desc("Timed runs per detector, the fastest is reported"), cl::init(3));
+static cl::opt<unsigned> WarshallMaxBlocks("warshall-max-blocks",
+    cl::desc("Skip the O(n^3) Warshall detector on larger functions"), cl::init(256));
+
+namespace
+{
+    struct DetectorResult
+    {
+        bool ran = false;
+        int loops = 0;
+        double micros = 0;
+        size_t peakBytes = 0;
+    };
+
+    // runs the detector once under the allocation counter, then times the remaining repetitions
+    template <typename Detector>
+    DetectorResult measure(Detector detector)
+    {
+        DetectorResult result;
+        result.ran = true;
+        size_t before = AllocationCounter::resetPeak();
+        auto start = std::chrono::steady_clock::now();
+        result.loops = detector();
+        auto stop = std::chrono::steady_clock::now();
+        result.peakBytes = AllocationCounter::peak().load() - before;
+        result.micros = std::chrono::duration<double, std::micro>(stop - start).count();
+        for (unsigned rep = 1; rep < Repetitions; rep++)
+        {
+            start = std::chrono::steady_clock::now();
+            detector();
+            stop = std::chrono::steady_clock::now();
+            result.micros = std::min(result.micros, std::chrono::duration<double, std::micro>(stop - start).count());
+        }
+        return result;
+    }
+
+    struct Totals
+    {
+        unsigned functions = 0;
+        double domMicros = 0;
+        double warshallMicros = 0;
+        double fastMicros = 0;
+        long domLoops = 0;
+        long warshallLoops = 0;
+        long fastLoops = 0;
+    };
+
+    // functions are bucketed by block count for the speedup table
+    const unsigned BucketLimits[] = {8, 32, 128, ~0u};
+    const char *BucketNames[] = {"1-8", "9-32", "33-128", "129+"};
+    const unsigned NumBuckets = 4;
+    const char *BucketTotalName = "total";
+
+    unsigned bucketOf(unsigned blocks)
+    {
+        unsigned bucket = 0;
+        while (blocks > BucketLimits[bucket])
+        {
+            bucket++;
+        }
+        return bucket;
+    }
+
+    double ratio(double numerator, double denominator)
+    {
+        return denominator > 0 ? numerator / denominator : 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "dominator vs Warshall loop detector benchmark\n");
+
+    Totals overall;
+    // Warshall only runs on some functions, so its speedups are computed over those alone
+    Totals comparable[NumBuckets];
+
+    if (Format == OutputFormat::CSV)
+    {
+        outs() << "module,function,blocks,edges,reducible,"
+               << "dom_loops,dom_us,dom_peak_bytes,"
+               << "warshall_loops,warshall_us,warshall_peak_bytes,"
+               << "fast_loops,fast_us,fast_peak_bytes,multi_entry_extra\n";
+    }
+
+    for (const std::string &path : InputFiles)
+    {
+        LLVMContext context;
+        SMDiagnostic err;
+        std::unique_ptr<Module> module = parseIRFile(path, err, context);
+        if (!module)
+        {
+            err.print(argv[0], errs());
+            continue;
+        }
+
+        for (const Function &func : *module)
+        {
+            if (func.isDeclaration())
+            {
+                continue;
+            }
+            Function &mutableFunc = const_cast<Function &>(func);
+
+            DetectorResult dom = measure([&]()
+            {
+                DominatorTree domTree(mutableFunc);
+                LoopInfo loopInfo(domTree);
+                IndexedCFG cfg(func);
+                return static_cast<int>(computeLoopStats(loopInfo, cfg).numLoops());
+            });
+
+            DetectorResult warshall;
+            if (func.size() <= WarshallMaxBlocks)
+            {
+                warshall = measure([&]()
+                {
+                    DominatorTree domTree(mutableFunc);
+                    WarshallLoopDetector detector(domTree, nulls(), false);
+                    return detector.countLoops(func);
+                });
+            }
+
+            bool reducible = true;
+            unsigned numEdges = 0;
+            DetectorResult fast = measure([&]()
+            {
+                IndexedCFG cfg(func);
+                StructuralSummary summary = computeStructuralSummary(cfg.graph);
+                reducible = summary.reducible;
+                numEdges = cfg.graph.numEdges();
+                return static_cast<int>(summary.numLoops());
+            });
+
+            overall.functions++;
+            overall.domMicros += dom.micros;
+            overall.fastMicros += fast.micros;
+            overall.domLoops += dom.loops;
+            overall.fastLoops += fast.loops;
+            if (warshall.ran)
+            {
+                Totals &bucket = comparable[bucketOf(func.size())];
+                bucket.functions++;
+                bucket.domMicros += dom.micros;
+                bucket.warshallMicros += warshall.micros;
+                bucket.fastMicros += fast.micros;
+                bucket.domLoops += dom.loops;
+                bucket.warshallLoops += warshall.loops;
+                bucket.fastLoops += fast.loops;
+                overall.warshallMicros += warshall.micros;
+                overall.warshallLoops += warshall.loops;
+            }
+
+            if (Format == OutputFormat::JSON)
+            {
+                json row = {
+                    {"module", path}, {"function", func.getName().str()},
+                    {"blocks", func.size()}, {"edges", numEdges}, {"reducible", reducible},
+                    {"dom", {{"loops", dom.loops}, {"us", dom.micros}, {"peakBytes", dom.peakBytes}}},
+                    {"fast", {{"loops", fast.loops}, {"us", fast.micros}, {"peakBytes", fast.peakBytes}}},
+                };
+                if (warshall.ran)
+                {
+                    row["warshall"] = {{"loops", warshall.loops}, {"us", warshall.micros}, {"peakBytes", warshall.peakBytes}};
+                    row["multiEntryExtra"] = warshall.loops - dom.loops;
+                }
+                outs() << row.dump() << "\n";
+            }
+            else
+            {
+                outs() << path << "," << func.getName() << "," << func.size() << "," << numEdges << ","
+                       << (reducible ? 1 : 0) << ","
+                       << dom.loops << "," << format("%.2f", dom.micros) << "," << dom.peakBytes << ",";
+                if (warshall.ran)
+                {
+                    outs() << warshall.loops << "," << format("%.2f", warshall.micros) << "," << warshall.peakBytes << ",";
+                }
+                else
+                {
+                    outs() << ",,,";
+                }
+                outs() << fast.loops << "," << format("%.2f", fast.micros) << "," << fast.peakBytes << ",";
+                if (warshall.ran)
+                {
+                    outs() << (warshall.loops - dom.loops);
+                }
+                outs() << "\n";
+            }
+        }
+    }
+
+    errs() << "\nfunctions: " << overall.functions
+           << "  loops dom/warshall/fast: " << overall.domLoops << "/" << overall.warshallLoops << "/" << overall.fastLoops
+           << "\n\n";
+    errs() << "blocks   functions       dom_us  warshall_us      fast_us   warshall/dom       dom/fast      extra\n";
+    Totals all;
+    for (unsigned bucket = 0; bucket < NumBuckets; bucket++)
+    {
+        const Totals &t = comparable[bucket];
+        all.functions += t.functions;
+        all.domMicros += t.domMicros;
+        all.warshallMicros += t.warshallMicros;
+        all.fastMicros += t.fastMicros;
+        all.domLoops += t.domLoops;
+        all.warshallLoops += t.warshallLoops;
+        errs() << format("%-8s %9u %12.1f %12.1f %12.1f %13.2fx %13.2fx %10ld\n", BucketNames[bucket], t.functions,
+                         t.domMicros, t.warshallMicros, t.fastMicros, ratio(t.warshallMicros, t.domMicros),
+                         ratio(t.domMicros, t.fastMicros), t.warshallLoops - t.domLoops);
+    }
+    errs() << format("%-8s %9u %12.1f %12.1f %12.1f %13.2fx %13.2fx %10ld\n", BucketTotalName, all.functions,
+                     all.domMicros, all.warshallMicros, all.fastMicros, ratio(all.warshallMicros, all.domMicros),
+                     ratio(all.domMicros, all.fastMicros), all.warshallLoops - all.domLoops);
+    if (all.functions != overall.functions)
+    {
+        errs() << (overall.functions - all.functions) << " functions over -warshall-max-blocks are only in the "
+               << "dom/fast totals: " << format("%.2fx", ratio(overall.domMicros, overall.fastMicros)) << "\n";
+    }
+    return 0;
+}
@@ -21,135 +21,438 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
 
-#include <nlohmann/json.hpp>
-#include<valarray>
-#include <fstream>
-#include <sstream>      // std::stringstream, std::stringbuf
+#include "AsyncWriter.h"
+#include "ColumnarStats.h"
+#include "DominatorEngines.h"
+#include "FusedMetrics.h"
+#include "MetricAnalyses.h"
+#include "MetricMetadata.h"
+#include "LoopStats.h"
+#include "MetricSummary.h"
+#include "ShardedResults.h"
+#include "StatsAccumulator.h"
+#include "StatsShard.h"
+#include "StatsWriter.h"
+#include "StructuralHash.h"
+#include "StructuralLoops.h"
+#include "WarshallLoops.h"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stack>
 #include <set>
-using json = nlohmann::json;
 using namespace llvm;
 
-#define TEST true
+static cl::opt<backedges::DomEngineKind> DomEngine("dom-engine",
+    cl::desc("Dominator algorithm used by -dominatorspass and -propdompass"),
+    cl::values(clEnumValN(backedges::DomEngineKind::CooperHarveyKennedy, "chk", "iterative Cooper-Harvey-Kennedy"),
+               clEnumValN(backedges::DomEngineKind::LengauerTarjan, "lt", "Lengauer-Tarjan with path compression"),
+               clEnumValN(backedges::DomEngineKind::SemiNCA, "snca", "LLVM's DominatorTree (Semi-NCA)")),
+    cl::init(backedges::DomEngineKind::SemiNCA));
+
+enum class LoopTierKind
+{
+    Exact,
+    Fast
+};
+
+static cl::opt<LoopTierKind> LoopTier("loop-tier",
+    cl::desc("How -backedge, -allloops and -toploops find loops"),
+    cl::values(clEnumValN(LoopTierKind::Exact, "exact", "DominatorTree and LoopInfo"),
+               clEnumValN(LoopTierKind::Fast, "fast", "one DFS over the CFG, approximate on irreducible CFGs")),
+    cl::init(LoopTierKind::Exact));
+
+enum class StatsDetail
+{
+    Summary,
+    PerFunction,
+    Full
+};
+
+static cl::opt<StatsDetail> StatsDetailLevel("stats-detail",
+    cl::desc("How much of every pass's results testResults/<CountName>.json gets"),
+    cl::values(clEnumValN(StatsDetail::Summary, "summary", "the summary only, nothing is kept per function"),
+               clEnumValN(StatsDetail::PerFunction, "per-function", "the summary and every function's value in \"Test\""),
+               clEnumValN(StatsDetail::Full, "full", "per-function plus -stats-extended and -stats-sketch")),
+    cl::init(StatsDetail::PerFunction));
+
+static cl::opt<bool> StatsExtended("stats-extended",
+    cl::desc("Add the standard deviation and the largest functions to every summary"));
+static cl::opt<unsigned> StatsTopK("stats-top-k",
+    cl::desc("How many of the largest functions -stats-extended lists"), cl::init(5));
+static cl::opt<bool> StatsSketch("stats-sketch",
+    cl::desc("Add p50/p90/p99/p999 to every summary and write the mergeable histogram behind them"));
+static cl::opt<std::string> StatsShardDir("stats-shard-dir",
+    cl::desc("Also write each pass's accumulators to a uniquely named shard in this directory"),
+    cl::value_desc("dir"));
+static cl::opt<bool> StatsNdjson("stats-ndjson",
+    cl::desc("Stream testResults/<CountName>.ndjson, a line per function as it is done and the summary last"));
+static cl::opt<bool> StatsColumnar("stats-columnar",
+    cl::desc("Also write testResults/<CountName>.stats.bin, the per function values as mmapable columns"));
+static cl::opt<bool> StatsAsync("stats-async",
+    cl::desc("Format and write the stats files on a background thread, the last pass waits for it"));
+static cl::opt<bool> DedupShapes("dedup-shapes",
+    cl::desc("In -allstats and the new pass manager's metrics, compute -warshloopdetector, -controldep and "
+             "-reachable once per CFG shape and reuse them for every function with the same shape"));
+static cl::opt<bool> StatsMetadata("stats-metadata",
+    cl::desc("In -allstats and the new pass manager's metrics, take a function's metrics from its !backedges.metrics "
+             "while its structural hash matches, and attach what was computed there (keep it with -o)"));
+
+// the shapes seen this run, shared by every pass that deduplicates
+static backedges::ShapeMemo &shapeMemo()
+{
+    static backedges::ShapeMemo memo;
+    return memo;
+}
+
+static void printMetadataStats(const backedges::MetricMetadata &metadata)
+{
+    errs() << "!" << backedges::MetricMetadataName << ": " << metadata.numHits() << " hits, "
+           << metadata.numMisses() << " misses\n";
+}
 
 namespace
 {
     class HelperFunctions
     {
     public:
-        static json createAndWriteJson(const std::vector<int> & vecCount,
-                                  const std::vector<std::string> & vecFuncName,
+        // sets a pass's series up for this run, before the first function is added. The
+        // count name marks the pass's own series, the one -stats-ndjson streams and report()
+        // finishes; the dominators per block series go without.
+        template <typename T>
+        static void startSeries(backedges::MetricSeries<T> &series, StringRef countName = StringRef())
+        {
+            series.top.setLimit(extendedStats() ? StatsTopK : 0);
+            // the columns are the per function values, they have to be kept to be written
+            series.keepValues = StatsDetailLevel != StatsDetail::Summary || StatsColumnar;
+            // the sketch buckets integers, the per block dominator averages stay out of it
+            if (sketchStats() && std::is_integral<T>::value)
+            {
+                series.sketch.enable();
+            }
+            if (countName.empty())
+            {
+                return;
+            }
+            passesInFlight++;
+            startStaging(series);
+            if (StatsNdjson && !series.ndjson.open("testResults/" + countName + ".ndjson", countName))
+            {
+                errs() << "cannot create testResults/" << countName << ".ndjson\n";
+            }
+        }
+        
+        // one function's value. The results are staged by the function's place in the module
+        // and go into the series in that order, so any number of threads may record at once;
+        // with one thread every value goes through, and out with -stats-ndjson, right away.
+        static void record(backedges::MetricSeries<int> &series, const Function &func, int value)
+        {
+            FunctionResult result = {func.getName(), value, nullptr, 0};
+            stage(series, func, result);
+        }
+        
+        static void recordDominators(backedges::MetricSeries<int> &series,
+                                     backedges::MetricSeries<double> &byBlock,
+                                     const Function &func, int count, double domPerBlock)
+        {
+            FunctionResult result = {func.getName(), count, &byBlock, domPerBlock};
+            stage(series, func, result);
+        }
+        
+        static backedges::MetricSummary createAndWriteJson(backedges::MetricSeries<int> &series,
                                   const std::string &countName,
                                   bool turnOnSummation = false,
                                   bool turnOnMin = true,
-                                  bool turnOnAvg = true,
-                                  bool writeToFile = true,
-                                  bool eraseTest = true)
-        {
-            std::valarray<int> seq {vecCount.data(), vecCount.size()};
-            double average = seq.sum()/static_cast<double>(vecCount.size());
-            int iMax = seq.max();
-            int iMin = seq.min();
-            std::string sMaxFuncName;
-            std::string sMinFuncName;
-            for (size_t i = 0; i < vecCount.size(); i++)
-            {
-                if(iMax == vecCount[i])
-                {
-                    sMaxFuncName = vecFuncName[i];
-                }
-                if(iMin == vecCount[i])
-                {
-                    sMinFuncName = vecFuncName[i];
-                }
+                                  bool turnOnAvg = true)
+        {
+            finishStaging(series);
+            backedges::ShardMetric metric = backedges::shardMetricOf(series, countName, turnOnSummation, turnOnMin,
+                                                                     turnOnAvg, extendedStats());
+            return report(metric, series);
+        }
+        
+        // the fast loop tier is only exact on reducible CFGs, say how many functions were not
+        static backedges::MetricSummary createAndWriteLoopTierJson(backedges::MetricSeries<int> &series,
+                                               const std::string &countName,
+                                               int irreducibleCount,
+                                               bool turnOnSummation = false,
+                                               bool turnOnMin = true,
+                                               bool turnOnAvg = true)
+        {
+            finishStaging(series);
+            backedges::ShardMetric metric = backedges::shardMetricOf(series, countName, turnOnSummation, turnOnMin,
+                                                                     turnOnAvg, extendedStats());
+            if (LoopTier == LoopTierKind::Fast)
+            {
+                metric.hasTier = true;
+                metric.irreducibleFunctions = irreducibleCount;
             }
-            json j;
-            
-            if(turnOnMin)
+            return report(metric, series);
+        }
+        
+        static backedges::MetricSummary createAndWriteDominatorJson(backedges::MetricSeries<int> &series,
+                                                const backedges::MetricSeries<double> &byBlock,
+                                                const std::string &countName)
+        {
+            finishStaging(series);
+            backedges::ShardMetric metric = backedges::shardMetricOf(series, countName, false, true, true, extendedStats());
+            metric.hasByBlock = true;
+            metric.byBlock = backedges::namedStats(byBlock.stats);
+            return report(metric, series, &byBlock);
+        }
+        
+    private:
+        // passes started on this module and not reported yet, the last one waits for the writer
+        static unsigned passesInFlight;
+        
+        // what a pass records for a function, byBlock only for the dominator passes
+        struct FunctionResult
+        {
+            StringRef functionName;
+            int value;
+            backedges::MetricSeries<double> *byBlock;
+            double domPerBlock;
+        };
+        
+        typedef backedges::ShardedResults<FunctionResult> StagedResults;
+        
+        // a pass's results on their way into its series. Entries are only made and removed
+        // between functions, recording just looks them up.
+        static std::map<const backedges::MetricSeries<int> *, std::unique_ptr<StagedResults>> staged;
+        
+        // function definitions in module order, what the results are keyed by
+        static std::mutex indexLock;
+        static const Module *indexedModule;
+        static DenseMap<const Function *, unsigned> functionIndices;
+        
+        static void startStaging(backedges::MetricSeries<int> &series)
+        {
+            staged[&series].reset(new StagedResults());
+        }
+        
+        // the dominators per block series go in with their pass's results
+        static void startStaging(backedges::MetricSeries<double> &) {}
+        
+        static void stage(backedges::MetricSeries<int> &series, const Function &func, const FunctionResult &result)
+        {
+            auto found = staged.find(&series);
+            assert(found != staged.end() && "series recorded before startSeries");
+            StagedResults &results = *found->second;
+            results.add(functionIndex(func), result);
+            results.drainReady([&](unsigned, const FunctionResult &ready)
+            {
+                apply(series, ready);
+            });
+        }
+        
+        // the end of the module: whatever is still staged, then the series is on its own again
+        static void finishStaging(backedges::MetricSeries<int> &series)
+        {
+            auto found = staged.find(&series);
+            if (found == staged.end())
             {
-                j["Minimum"] = { {"functionName", sMinFuncName}, {countName, iMin} };
+                return;
             }
-            
-            j["Maximum"] = { {"functionName", sMaxFuncName}, {countName, iMax} };
-            
-            if(turnOnAvg)
+            found->second->drainAll([&](unsigned, const FunctionResult &ready)
             {
-                j["Average"] = average;
+                apply(series, ready);
+            });
+            staged.erase(found);
+        }
+        
+        // only ever called by the thread draining the staged results
+        static void apply(backedges::MetricSeries<int> &series, const FunctionResult &result)
+        {
+            if (result.byBlock != nullptr)
+            {
+                result.byBlock->add(result.functionName, result.domPerBlock);
             }
-            
-            if(turnOnSummation)
+            series.add(result.functionName, result.value);
+            if (!series.ndjson.isOpen())
             {
-                j["Summation"] = seq.sum();
+                return;
             }
-                
-
-#if TEST
-            json jTest;
-            for (size_t i = 0; i < vecCount.size(); i++)
+            backedges::AsyncWriter *writer = StatsAsync ? &backedges::AsyncWriter::shared() : nullptr;
+            if (result.byBlock != nullptr && writer != nullptr)
             {
-                jTest[i] = { {"functionName", vecFuncName[i]}, {countName, vecCount[i]} };
+                writer->record(series.ndjson, savedName(result.functionName), result.value, result.domPerBlock);
             }
-            j["Test"] = jTest;
-#endif
-
-            if(writeToFile)
+            else if (result.byBlock != nullptr)
+            {
+                series.ndjson.record(result.functionName, result.value, result.domPerBlock);
+            }
+            else if (writer != nullptr)
             {
-                std::ofstream o("testResults/"+countName+".json");
-                o << std::setw(4) << j << std::endl;
+                writer->record(series.ndjson, savedName(result.functionName), result.value);
             }
-#if TEST
-            if(eraseTest)
+            else
             {
-                j.erase("Test");
+                series.ndjson.record(result.functionName, result.value);
             }
-#endif
-            return j;
         }
         
-         static void AddDominatorToJson(const std::vector<double> & domCount,json &j,
-                                        const std::string &countName)
+        static unsigned functionIndex(const Function &func)
         {
-            std::valarray<double> seq {domCount.data(), domCount.size()};
-            double average = seq.sum()/static_cast<double>(domCount.size());
-            
-            double iMax = seq.max();
-            double iMin = seq.min();
-            
-            std::string sMaxFuncName;
-            std::string sMinFuncName;
-            for (size_t i = 0; i < domCount.size(); i++)
+            std::lock_guard<std::mutex> guard(indexLock);
+            auto found = functionIndices.find(&func);
+            if (indexedModule == func.getParent() && found != functionIndices.end())
+            {
+                return found->second;
+            }
+            // a new module, or one that gained functions since it was indexed
+            indexedModule = func.getParent();
+            functionIndices.clear();
+            unsigned index = 0;
+            for (const Function &definition : *indexedModule)
             {
-                if(iMax == domCount[i])
+                if (!definition.isDeclaration())
                 {
-                    sMaxFuncName = j["Test"][i]["functionName"];
+                    functionIndices[&definition] = index++;
                 }
-                if(iMin == domCount[i])
+            }
+            return functionIndices.lookup(&func);
+        }
+        
+        static bool extendedStats()
+        {
+            return StatsExtended || StatsDetailLevel == StatsDetail::Full;
+        }
+        
+        static bool sketchStats()
+        {
+            return StatsSketch || StatsDetailLevel == StatsDetail::Full;
+        }
+        
+        // the interned copy, the function may be gone by the time the async writer gets to it
+        static StringRef savedName(StringRef functionName)
+        {
+            backedges::NameTable &names = backedges::NameTable::shared();
+            return names.name(names.intern(functionName));
+        }
+        
+        // everything was accumulated as the functions went by, nothing to scan here. With
+        // -stats-async the files are left to the writer thread; nothing touches the series
+        // again before the barrier at the end of the module, so it reads them in place.
+        static backedges::MetricSummary report(const backedges::ShardMetric &metric,
+                                               backedges::MetricSeries<int> &series,
+                                               const backedges::MetricSeries<double> *byBlock = nullptr)
+        {
+            backedges::MetricSummary summary = metric.summarize();
+            if (StatsAsync)
+            {
+                backedges::AsyncWriter::shared().submit([metric, summary, &series, byBlock]()
                 {
-                    sMinFuncName = j["Test"][i]["functionName"];
-                }
+                    writeFiles(metric, summary, series, byBlock);
+                });
             }
-            
-            j["DomByBlockAverage"] = average;
-            j["DomByBlockMax"] = {sMaxFuncName, iMax};
-            j["DomByBlockMin"] = {sMinFuncName, iMin};
-              
-#if TEST
-            for (size_t i = 0; i < domCount.size(); i++)
-            {
-                j["Test"][i]["DomPerBlock"] = domCount[i];
-            }
-#endif
-            std::ofstream o("testResults/"+countName+".json");
-            o << std::setw(4) << j << std::endl;
-
-#if TEST
-            j.erase("Test");
-#endif
+            else
+            {
+                writeFiles(metric, summary, series, byBlock);
+            }
+            if (--passesInFlight == 0 && StatsAsync)
+            {
+                backedges::AsyncWriter::shared().flush();
+            }
+            return summary;
         }
-    private:
+        
+        static void writeFiles(const backedges::ShardMetric &metric,
+                               const backedges::MetricSummary &summary,
+                               backedges::MetricSeries<int> &series,
+                               const backedges::MetricSeries<double> *byBlock)
+        {
+            if (series.ndjson.isOpen())
+            {
+                series.ndjson.finish(summary);
+            }
+            writeJson(summary, series, byBlock != nullptr ? &byBlock->records : nullptr);
+            if (!StatsShardDir.empty())
+            {
+                writeShard(metric);
+            }
+            if (StatsColumnar)
+            {
+                writeColumnar(metric, series, byBlock);
+            }
+        }
+        
+        static void writeColumnar(const backedges::ShardMetric &metric,
+                                  const backedges::MetricSeries<int> &series,
+                                  const backedges::MetricSeries<double> *byBlock)
+        {
+            std::error_code EC;
+            raw_fd_ostream o("testResults/" + metric.countName + ".stats.bin", EC, sys::fs::F_None);
+            if (EC)
+            {
+                return;
+            }
+            o.SetBufferSize(1 << 16);
+            backedges::writeColumnarStats(o, metric, series, byBlock, backedges::NameTable::shared());
+        }
+        
+        // -stats-shard-dir: a uniquely named file per pass and run, so runs over many modules
+        // in parallel do not overwrite each other and statsmerge can combine them
+        static void writeShard(const backedges::ShardMetric &metric)
+        {
+            if (sys::fs::create_directories(StatsShardDir))
+            {
+                errs() << "cannot create " << StatsShardDir << "\n";
+                return;
+            }
+            int fd;
+            SmallString<128> path;
+            if (sys::fs::createUniqueFile(StatsShardDir + "/" + metric.countName + "-%%%%%%%%%%%%%%%%.shard.json", fd, path))
+            {
+                errs() << "cannot create a shard in " << StatsShardDir << "\n";
+                return;
+            }
+            raw_fd_ostream o(fd, true);
+            backedges::writeShard(o, std::vector<backedges::ShardMetric>(1, metric));
+        }
+        
+        // streams testResults/<countName>.json, per function records included when the series kept them
+        static void writeJson(const backedges::MetricSummary &summary,
+                              const backedges::MetricSeries<int> &series,
+                              const std::vector<backedges::FunctionRecord<double>> *domCount = nullptr)
+        {
+            std::error_code EC;
+            raw_fd_ostream o("testResults/" + summary.countName + ".json", EC, sys::fs::F_Text);
+            if (EC)
+            {
+                return;
+            }
+            o.SetBufferSize(1 << 16);
+            if (!series.keepValues)
+            {
+                backedges::writeResultsJson(o, summary, nullptr);
+                return;
+            }
+            const backedges::NameTable &names = backedges::NameTable::shared();
+            auto name = [&](size_t i) { return names.name(series.records[i].nameId); };
+            auto value = [&](size_t i) { return series.records[i].value; };
+            auto domPerBlock = [&](size_t i) { return (*domCount)[i].value; };
+            backedges::ResultRows rows = {series.records.size(), name, value, domCount != nullptr, domPerBlock};
+            backedges::writeResultsJson(o, summary, &rows);
+        }
+        
         HelperFunctions() = delete;
     };
+    
+    unsigned HelperFunctions::passesInFlight = 0;
+    std::map<const backedges::MetricSeries<int> *, std::unique_ptr<HelperFunctions::StagedResults>> HelperFunctions::staged;
+    std::mutex HelperFunctions::indexLock;
+    const Module *HelperFunctions::indexedModule = nullptr;
+    DenseMap<const Function *, unsigned> HelperFunctions::functionIndices;
 }
 
 namespace
@@ -157,8 +460,7 @@ namespace
     //2.1 Average, maximum and minimum number of basic blocks inside functions.
     struct BasicBlockFuncCounter : public FunctionPass
     {
-        static std::vector<int> vecBasicBlockCount;
-        static std::vector<std::string> vecBasicBlockFuncName;
+        static backedges::MetricSeries<int> basicBlockCounts;
         static char ID; // Pass identification, replacement for typeid
         BasicBlockFuncCounter() : FunctionPass(ID) {}
         virtual ~BasicBlockFuncCounter() {}
@@ -171,13 +473,17 @@ namespace
         //An iterator over a Function gives us a list of basic blocks.
         void getBasicBlockInfo(const Function& func) const
         {
-            vecBasicBlockCount.push_back(func.size());
-            vecBasicBlockFuncName.push_back(func.getName());
+            HelperFunctions::record(basicBlockCounts, func, func.size());
         }
 
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(basicBlockCounts, "BasicBlockCount");
+            return false;
+        }
+        
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecBasicBlockCount, vecBasicBlockFuncName, "BasicBlockCount");
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteJson(basicBlockCounts, "BasicBlockCount") << "\n";
             return false;
         }
 
@@ -185,8 +491,7 @@ namespace
 }
 
 char BasicBlockFuncCounter::ID = 0;
-std::vector<int> BasicBlockFuncCounter::vecBasicBlockCount;
-std::vector<std::string> BasicBlockFuncCounter::vecBasicBlockFuncName;
+backedges::MetricSeries<int> BasicBlockFuncCounter::basicBlockCounts;
 static RegisterPass<BasicBlockFuncCounter>
 X("basicblock", "basic block function counter pass.");
 
@@ -195,8 +500,7 @@ namespace
     // 2.2 Average, maximum and minimum number of CFG edges inside functions.
     struct CFGEdgeCounter : public FunctionPass
     {
-        static std::vector<int> veccCFGEdgeCount;
-        static std::vector<std::string> vecCFGEdgeFuncName;
+        static backedges::MetricSeries<int> cfgEdgeCounts;
         static char ID; // Pass identification, replacement for typeid
         CFGEdgeCounter() : FunctionPass(ID) {}
         virtual ~CFGEdgeCounter() {}
@@ -218,32 +522,137 @@ namespace
                 // count the jumps
                 numEdges += termInst->getNumSuccessors();
             }
-            veccCFGEdgeCount.push_back(numEdges);
-            vecCFGEdgeFuncName.push_back(func.getName());
+            HelperFunctions::record(cfgEdgeCounts, func, numEdges);
+        }
+        
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(cfgEdgeCounts, "CFGEdgeCount");
+            return false;
         }
         
         bool doFinalization(Module &M) override {
             
-            json j = HelperFunctions::createAndWriteJson(veccCFGEdgeCount, vecCFGEdgeFuncName, "CFGEdgeCount");
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteJson(cfgEdgeCounts, "CFGEdgeCount") << "\n";
             return false;
         }
     };
 }
 
-std::vector<int> CFGEdgeCounter::veccCFGEdgeCount;
-std::vector<std::string> CFGEdgeCounter::vecCFGEdgeFuncName;
+backedges::MetricSeries<int> CFGEdgeCounter::cfgEdgeCounts;
 char CFGEdgeCounter::ID = 0;
 static RegisterPass<CFGEdgeCounter>
 Y("cfgedge", "cfg edge function counter pass.");
 
+namespace
+{
+    // Walks the loop forest once per function and keeps the per-loop numbers the loop passes
+    // report, so running -backedge -loopbasicblock -allloops -toploops -exitcfgloops
+    // together pays for the LoopInfo traversal only once.
+    struct LoopStatsWrapperPass : public FunctionPass
+    {
+        static char ID; // Pass identification, replacement for typeid
+        backedges::LoopStats stats;
+        LoopStatsWrapperPass() : FunctionPass(ID) {}
+        virtual ~LoopStatsWrapperPass() {}
+        
+        bool runOnFunction(Function &F) override
+        {
+            LoopInfo &loopInfo = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+            backedges::IndexedCFG cfg(F);
+            stats = backedges::computeLoopStats(loopInfo, cfg);
+            return false;
+        }
+        
+        void getAnalysisUsage(AnalysisUsage &AU) const override
+        {
+            AU.addRequired<LoopInfoWrapperPass>();
+            AU.setPreservesAll();
+        }
+        
+        void releaseMemory() override
+        {
+            stats = backedges::LoopStats();
+        }
+        
+        const backedges::LoopStats &getStats() const
+        {
+            return stats;
+        }
+        
+        // O(1) innermost loop, membership and depth queries on block indices
+        const backedges::LoopForest &getForest() const
+        {
+            return stats.forest;
+        }
+    };
+}
+
+char LoopStatsWrapperPass::ID = 0;
+static RegisterPass<LoopStatsWrapperPass>
+LS("loopstats", "single traversal loop statistics.", true, true);
+
+namespace
+{
+    // -loop-tier=fast: back edges, loop headers and reducibility from one DFS over the CFG,
+    // without building a DominatorTree or LoopInfo.
+    struct StructuralSummaryWrapperPass : public FunctionPass
+    {
+        static char ID; // Pass identification, replacement for typeid
+        backedges::StructuralSummary summary;
+        StructuralSummaryWrapperPass() : FunctionPass(ID) {}
+        virtual ~StructuralSummaryWrapperPass() {}
+        
+        bool runOnFunction(Function &F) override
+        {
+            backedges::IndexedCFG cfg(F);
+            summary = backedges::computeStructuralSummary(cfg.graph);
+            return false;
+        }
+        
+        void getAnalysisUsage(AnalysisUsage &AU) const override
+        {
+            AU.setPreservesAll();
+        }
+        
+        void releaseMemory() override
+        {
+            summary = backedges::StructuralSummary();
+        }
+        
+        const backedges::StructuralSummary &getSummary() const
+        {
+            return summary;
+        }
+    };
+}
+
+char StructuralSummaryWrapperPass::ID = 0;
+static RegisterPass<StructuralSummaryWrapperPass>
+SS("structuralloops", "DFS edge classification and loop headers without LoopInfo.", true, true);
+
+namespace
+{
+    void addLoopTierRequirement(AnalysisUsage &AU)
+    {
+        if (LoopTier == LoopTierKind::Fast)
+        {
+            AU.addRequired<StructuralSummaryWrapperPass>();
+        }
+        else
+        {
+            AU.addRequired<LoopStatsWrapperPass>();
+        }
+    }
+}
+
 namespace
 {
   //2.3 Average, maximum and minimum number of single entry loops inside functions (count each loop based on a back edge).
   struct BackEdgeDetector : public FunctionPass
   {
-    static std::vector<int> vecBackEdgeCount;
-    static std::vector<std::string> vecBackEdgeFuncName;
+    static backedges::MetricSeries<int> backEdgeCounts;
+    static int irreducibleCount; // of the functions recorded this run
     static char ID; // Pass identification, replacement for typeid
     BackEdgeDetector() : FunctionPass(ID) {}
     virtual ~BackEdgeDetector() {}
@@ -256,46 +665,43 @@ namespace
     void getAnalysisUsage(AnalysisUsage &AU) const override
     {
         AU.setPreservesCFG();
-        AU.addRequired<LoopInfoWrapperPass>();
-    }
-    
-    void getLoopCountNested(const Loop &Toploop, int &backEdgesCount) const
-    {
-        std::vector<Loop *> nestedloops = Toploop.getSubLoops();
-          
-        for (Loop::iterator iter = nestedloops.begin(); iter != nestedloops.end(); ++iter)
-        {
-            Loop *loop =*iter;
-            backEdgesCount+=loop->getNumBackEdges();
-            getLoopCountNested(*loop,backEdgesCount);
-          }
+        addLoopTierRequirement(AU);
     }
     
     void getBackEdgeInfo(const Function& func) const
     {
-        LoopInfo &loopInfo = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-        int backEdgesCount = 0;
-        for (Loop::iterator iter = loopInfo.begin(); iter != loopInfo.end(); ++iter)
+        if (LoopTier == LoopTierKind::Fast)
         {
-            const Loop *loop =*iter;
-            backEdgesCount+=loop->getNumBackEdges();
-            getLoopCountNested(*loop, backEdgesCount);
-            
+            const backedges::StructuralSummary &summary = getAnalysis<StructuralSummaryWrapperPass>().getSummary();
+            HelperFunctions::record(backEdgeCounts, func, summary.numBackEdges);
+            if (!summary.reducible)
+            {
+                irreducibleCount++;
+            }
+        }
+        else
+        {
+            HelperFunctions::record(backEdgeCounts, func, getAnalysis<LoopStatsWrapperPass>().getStats().numBackEdges);
         }
-        vecBackEdgeCount.push_back(backEdgesCount);
-        vecBackEdgeFuncName.push_back(func.getName());
+    }
+    
+    bool doInitialization(Module &M) override
+    {
+        HelperFunctions::startSeries(backEdgeCounts, "BackEdgeCount");
+        irreducibleCount = 0;
+        return false;
     }
     
     bool doFinalization(Module &M) override {
-        json j = HelperFunctions::createAndWriteJson(vecBackEdgeCount, vecBackEdgeFuncName, "BackEdgeCount");
-        errs() << j.dump() <<"\n";
+        errs() << HelperFunctions::createAndWriteLoopTierJson(backEdgeCounts, "BackEdgeCount",
+                                                             irreducibleCount) << "\n";
         return false;
     }
   };
 }
 
-std::vector<int> BackEdgeDetector::vecBackEdgeCount;
-std::vector<std::string> BackEdgeDetector::vecBackEdgeFuncName;
+backedges::MetricSeries<int> BackEdgeDetector::backEdgeCounts;
+int BackEdgeDetector::irreducibleCount = 0;
 char BackEdgeDetector::ID = 0;
 static RegisterPass<BackEdgeDetector>
 Z("backedge", "back Edge detector pass.");
@@ -306,8 +712,7 @@ namespace
     //2.4 Average, maximum and minimum number of loop basic blocks inside functions
     struct LoopBasicBlockDetector : public FunctionPass
     {
-        static std::vector<int> vecLoopBasicBlockCount;
-        static std::vector<std::string> vecLoopBasicBlockFuncName;
+        static backedges::MetricSeries<int> loopBasicBlockCounts;
         static char ID; // Pass identification, replacement for typeid
         LoopBasicBlockDetector() :  FunctionPass(ID) {}
         virtual ~LoopBasicBlockDetector() {}
@@ -321,36 +726,30 @@ namespace
         void getAnalysisUsage(AnalysisUsage &AU) const override
         {
             AU.setPreservesCFG();
-            AU.addRequired<LoopInfoWrapperPass>();
+            AU.addRequired<LoopStatsWrapperPass>();
         }
         
+        // a top level loop's blocks already include its nested loops
         void getLoopBasicBlocInfo(const Function& func) const
         {
-            LoopInfo &loopInfo = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-            int loopBlockCounter = 0;
-            for (Loop::iterator iter = loopInfo.begin(); iter != loopInfo.end(); ++iter)
-            {
-                Loop *loop =*iter;
-                
-                for(Loop::block_iterator bIter = loop->block_begin(); bIter != loop->block_end(); ++bIter)
-                {
-                    loopBlockCounter++;
-                }
-            }
-            vecLoopBasicBlockCount.push_back(loopBlockCounter);
-            vecLoopBasicBlockFuncName.push_back(func.getName());
+            const backedges::LoopStats &stats = getAnalysis<LoopStatsWrapperPass>().getStats();
+            HelperFunctions::record(loopBasicBlockCounts, func, stats.numTopLevelLoopBlocks);
+        }
+        
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(loopBasicBlockCounts, "LoopBasicBlockCount");
+            return false;
         }
         
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecLoopBasicBlockCount, vecLoopBasicBlockFuncName, "LoopBasicBlockCount");
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteJson(loopBasicBlockCounts, "LoopBasicBlockCount") << "\n";
             return false;
         }
     };
 }
 
-std::vector<int> LoopBasicBlockDetector::vecLoopBasicBlockCount;
-std::vector<std::string> LoopBasicBlockDetector::vecLoopBasicBlockFuncName;
+backedges::MetricSeries<int> LoopBasicBlockDetector::loopBasicBlockCounts;
 char LoopBasicBlockDetector::ID = 0;
 static RegisterPass<LoopBasicBlockDetector>
 A("loopbasicblock", "loop basic block counter pass.");
@@ -360,9 +759,8 @@ namespace
     // 2.5 Average number of dominators for a basic block across all functions.
     struct DominatorsPass : public FunctionPass
     {
-        static std::vector<int> vecLoopDominatorsCount;
-        static std::vector<std::string> vecDominatorsFuncName;
-        static std::vector<double> vecLoopDominatorsByBlock;
+        static backedges::MetricSeries<int> dominatorCounts;
+        static backedges::MetricSeries<double> dominatorsByBlock;
         static char ID; // Pass identification, replacement for typeid
         DominatorsPass() :  FunctionPass(ID) {}
         virtual ~DominatorsPass() {}
@@ -375,51 +773,47 @@ namespace
         
         void getAnalysisUsage(AnalysisUsage &AU) const override
         {
-            AU.addRequired<DominatorTreeWrapperPass>();
+            // only the Semi-NCA engine reuses the tree the pass manager builds
+            if (DomEngine == backedges::DomEngineKind::SemiNCA)
+            {
+                AU.addRequired<DominatorTreeWrapperPass>();
+            }
             AU.setPreservesAll();
         }
         
         void getDominatorsInfo(const Function& func) const
         {
-            DominatorTree &DomTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+            backedges::IndexedCFG cfg(func);
+            backedges::DomTreeView domTree = DomEngine == backedges::DomEngineKind::SemiNCA
+                ? backedges::dominatorsFromLLVM(getAnalysis<DominatorTreeWrapperPass>().getDomTree(), cfg)
+                : backedges::buildDominators(cfg, DomEngine);
             int domCounter = 0;
-            for (Function::const_iterator iter = func.begin(); iter != func.end(); ++iter)
+            for (unsigned currBlock = 0; currBlock < cfg.size(); currBlock++)
             {
-                const BasicBlock &currBlock = *iter;
-                for (Function::const_iterator nextIter = func.begin(); nextIter != func.end(); ++nextIter)
-                {
-                    // does a block dominate itself? It does
-                    // what about strict dominance?
-                    /*if(iter == nextIter)
-                    {
-                        continue;
-                    }*/
-                    const BasicBlock &nextBlock = *nextIter;
-                    if (DomTree.dominates(&nextBlock, &currBlock))
-                    {
-                        domCounter++;
-                    }
-                }
+                // does a block dominate itself? It does
+                // the dominators of a block are its ancestors in the tree, no need to test every pair
+                domCounter += domTree.numDominators(currBlock);
             }
-            vecLoopDominatorsByBlock.push_back(domCounter / static_cast<double>(func.size()));
-            vecLoopDominatorsCount.push_back(domCounter);
-            vecDominatorsFuncName.push_back(func.getName());
+            HelperFunctions::recordDominators(dominatorCounts, dominatorsByBlock, func, domCounter,
+                                              domCounter / static_cast<double>(func.size()));
+        }
+        
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(dominatorCounts, "DominatorsCount");
+            HelperFunctions::startSeries(dominatorsByBlock);
+            return false;
         }
         
         bool doFinalization(Module &M) override {
-            const std::string jsonFileName = "DominatorsCount";
-            json j = HelperFunctions::createAndWriteJson(vecLoopDominatorsCount, vecDominatorsFuncName, jsonFileName, false, true, true, false, false);
-            
-            HelperFunctions::AddDominatorToJson(vecLoopDominatorsByBlock, j, jsonFileName);
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteDominatorJson(dominatorCounts, dominatorsByBlock, "DominatorsCount") << "\n";
             return false;
         }
     };
 }
 
-std::vector<int> DominatorsPass::vecLoopDominatorsCount;
-std::vector<double> DominatorsPass::vecLoopDominatorsByBlock;
-std::vector<std::string> DominatorsPass::vecDominatorsFuncName;
+backedges::MetricSeries<int> DominatorsPass::dominatorCounts;
+backedges::MetricSeries<double> DominatorsPass::dominatorsByBlock;
 char DominatorsPass::ID = 0;
 static RegisterPass<DominatorsPass>
 B("dominatorspass", "loop dominates pass.");
@@ -429,9 +823,8 @@ namespace
     // 2.5 Average number of dominators for a basic block across all functions.
     struct PropDominatorsPass : public FunctionPass
     {
-        static std::vector<double> vecLoopDominatorsByBlock;
-        static std::vector<int> vecLoopDominatorsCount;
-        static std::vector<std::string> vecDominatorsFuncName;
+        static backedges::MetricSeries<int> dominatorCounts;
+        static backedges::MetricSeries<double> dominatorsByBlock;
         static char ID; // Pass identification, replacement for typeid
         PropDominatorsPass() :  FunctionPass(ID) {}
         virtual ~PropDominatorsPass() {}
@@ -444,51 +837,46 @@ namespace
         
         void getAnalysisUsage(AnalysisUsage &AU) const override
         {
-            AU.addRequired<DominatorTreeWrapperPass>();
+            // only the Semi-NCA engine reuses the tree the pass manager builds
+            if (DomEngine == backedges::DomEngineKind::SemiNCA)
+            {
+                AU.addRequired<DominatorTreeWrapperPass>();
+            }
             AU.setPreservesAll();
         }
         
         void getDominatorsInfo(const Function& func) const
         {
-            DominatorTree &DomTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+            backedges::IndexedCFG cfg(func);
+            backedges::DomTreeView domTree = DomEngine == backedges::DomEngineKind::SemiNCA
+                ? backedges::dominatorsFromLLVM(getAnalysis<DominatorTreeWrapperPass>().getDomTree(), cfg)
+                : backedges::buildDominators(cfg, DomEngine);
             int domCounter = 0;
-            for (Function::const_iterator iter = func.begin(); iter != func.end(); ++iter)
+            for (unsigned currBlock = 0; currBlock < cfg.size(); currBlock++)
             {
-                const BasicBlock &currBlock = *iter;
-                for (Function::const_iterator nextIter = func.begin(); nextIter != func.end(); ++nextIter)
-                {
-                    // does a block dominate itself? It does
-                    // what about strict dominance?
-                    /*if(iter == nextIter)
-                     {
-                     continue;
-                     }*/
-                    const BasicBlock &nextBlock = *nextIter;
-                    if (DomTree.properlyDominates(&nextBlock, &currBlock))
-                    {
-                        domCounter++;
-                    }
-                }
+                // strict dominance, a block does not properly dominate itself
+                // the dominators of a block are its ancestors in the tree, no need to test every pair
+                domCounter += domTree.numProperDominators(currBlock);
             }
-            vecLoopDominatorsByBlock.push_back(domCounter / static_cast<double>(func.size()));
-            vecLoopDominatorsCount.push_back(domCounter);
-            vecDominatorsFuncName.push_back(func.getName());
+            HelperFunctions::recordDominators(dominatorCounts, dominatorsByBlock, func, domCounter,
+                                              domCounter / static_cast<double>(func.size()));
+        }
+        
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(dominatorCounts, "PropDominatorsPass");
+            HelperFunctions::startSeries(dominatorsByBlock);
+            return false;
         }
         
         bool doFinalization(Module &M) override {
-            const std::string jsonFileName = "PropDominatorsPass";
-            json j = HelperFunctions::createAndWriteJson(vecLoopDominatorsCount, vecDominatorsFuncName, jsonFileName,false, true, true, false, false);
-            
-            HelperFunctions::AddDominatorToJson(vecLoopDominatorsByBlock, j, jsonFileName);
-            
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteDominatorJson(dominatorCounts, dominatorsByBlock, "PropDominatorsPass") << "\n";
             return false;
         }
     };
 }
-std::vector<double> PropDominatorsPass::vecLoopDominatorsByBlock;
-std::vector<int> PropDominatorsPass::vecLoopDominatorsCount;
-std::vector<std::string> PropDominatorsPass::vecDominatorsFuncName;
+backedges::MetricSeries<int> PropDominatorsPass::dominatorCounts;
+backedges::MetricSeries<double> PropDominatorsPass::dominatorsByBlock;
 char PropDominatorsPass::ID = 0;
 static RegisterPass<PropDominatorsPass>
 BB("propdompass", "loop properly dominates pass.");
@@ -498,8 +886,8 @@ namespace
     //3.1.1 The number of loops in all functions in the input C file
     struct AllLoopCount : public FunctionPass
     {
-        static std::vector<int> vecFuncLoopCounts;
-        static std::vector<std::string> vecFuncLoopCountsFuncName;
+        static backedges::MetricSeries<int> loopCounts;
+        static int irreducibleCount;
         static char ID; // Pass identification, replacement for typeid
         AllLoopCount() :  FunctionPass(ID) {}
         virtual ~AllLoopCount() {}
@@ -513,47 +901,43 @@ namespace
         void getAnalysisUsage(AnalysisUsage &AU) const override
         {
             AU.setPreservesCFG();
-            AU.addRequired<LoopInfoWrapperPass>();
+            addLoopTierRequirement(AU);
         }
         
-        int getLoopCountNested(const Loop &Toploop) const
+        void getLoopCount(const Function& func) const
         {
-            int nNestedLoopCount = 1;
-            std::vector<Loop *> nestedloops = Toploop.getSubLoops();
-            
-            for (Loop::iterator iter = nestedloops.begin(); iter != nestedloops.end(); ++iter)
+            if (LoopTier == LoopTierKind::Fast)
+            {
+                const backedges::StructuralSummary &summary = getAnalysis<StructuralSummaryWrapperPass>().getSummary();
+                HelperFunctions::record(loopCounts, func, summary.numLoops());
+                if (!summary.reducible)
+                {
+                    irreducibleCount++;
+                }
+            }
+            else
             {
-                Loop *loop =*iter;
-                nNestedLoopCount += getLoopCountNested(*loop);
+                HelperFunctions::record(loopCounts, func, getAnalysis<LoopStatsWrapperPass>().getStats().numLoops());
             }
-            
-            return nNestedLoopCount;
         }
         
-        void getLoopCount(const Function& func) const
+        bool doInitialization(Module &M) override
         {
-            LoopInfo &loopInfo = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-            int loopCounter = 0;
-            for (Loop::iterator iter = loopInfo.begin(); iter != loopInfo.end(); ++iter)
-            {
-                Loop *loop =*iter;
-                loopCounter += getLoopCountNested(*loop);
-                
-            }
-            vecFuncLoopCounts.push_back(loopCounter);
-            vecFuncLoopCountsFuncName.push_back(func.getName());
+            HelperFunctions::startSeries(loopCounts, "AllLoopsCount");
+            irreducibleCount = 0;
+            return false;
         }
         
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecFuncLoopCounts, vecFuncLoopCountsFuncName, "AllLoopsCount", true, false, false);
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteLoopTierJson(loopCounts, "AllLoopsCount",
+                                                                 irreducibleCount, true, false, false) << "\n";
             return false;
         }
     };
 }
 
-std::vector<int> AllLoopCount::vecFuncLoopCounts;
-std::vector<std::string> AllLoopCount::vecFuncLoopCountsFuncName;
+backedges::MetricSeries<int> AllLoopCount::loopCounts;
+int AllLoopCount::irreducibleCount = 0;
 char AllLoopCount::ID = 0;
 static RegisterPass<AllLoopCount>
 C("allloops", "counts all the loops including nested loops.");
@@ -563,8 +947,8 @@ namespace
     //3.1.2 The number of loops that are outermost loops (not nested in any other loops)
     struct TopLevelLoopCount : public FunctionPass
     {
-        static std::vector<int> vecTopLoopCounts;
-        static std::vector<std::string> vecTopLoopCountsFuncName;
+        static backedges::MetricSeries<int> topLoopCounts;
+        static int irreducibleCount;
         static char ID; // Pass identification, replacement for typeid
         TopLevelLoopCount() :  FunctionPass(ID) {}
         virtual ~TopLevelLoopCount() {}
@@ -578,31 +962,43 @@ namespace
         void getAnalysisUsage(AnalysisUsage &AU) const override
         {
             AU.setPreservesCFG();
-            AU.addRequired<LoopInfoWrapperPass>();
+            addLoopTierRequirement(AU);
         }
         
         void getLoopCount(const Function& func) const
         {
-            LoopInfo &loopInfo = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-            int loopCounter = 0;
-            for (Loop::iterator iter = loopInfo.begin(); iter != loopInfo.end(); ++iter)
+            if (LoopTier == LoopTierKind::Fast)
             {
-                loopCounter++;
+                const backedges::StructuralSummary &summary = getAnalysis<StructuralSummaryWrapperPass>().getSummary();
+                HelperFunctions::record(topLoopCounts, func, summary.numTopLevelLoops);
+                if (!summary.reducible)
+                {
+                    irreducibleCount++;
+                }
+            }
+            else
+            {
+                HelperFunctions::record(topLoopCounts, func, getAnalysis<LoopStatsWrapperPass>().getStats().numTopLevelLoops);
             }
-            vecTopLoopCounts.push_back(loopCounter);
-            vecTopLoopCountsFuncName.push_back(func.getName());
+        }
+        
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(topLoopCounts, "TopLoopCount");
+            irreducibleCount = 0;
+            return false;
         }
         
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecTopLoopCounts, vecTopLoopCountsFuncName, "TopLoopCount", true, false);
-            errs() << j.dump();
+            errs() << HelperFunctions::createAndWriteLoopTierJson(topLoopCounts, "TopLoopCount",
+                                                                 irreducibleCount, true, false);
             return false;
         }
     };
 }
 
-std::vector<int> TopLevelLoopCount::vecTopLoopCounts;
-std::vector<std::string> TopLevelLoopCount::vecTopLoopCountsFuncName;
+backedges::MetricSeries<int> TopLevelLoopCount::topLoopCounts;
+int TopLevelLoopCount::irreducibleCount = 0;
 char TopLevelLoopCount::ID = 0;
 static RegisterPass<TopLevelLoopCount>
 D("toploops", "counts all the top loops ie not including nested loops.");
@@ -613,8 +1009,7 @@ namespace
     // body, but the destination node is not)
     struct LoopExitCFGCount : public FunctionPass
     {
-        static std::vector<int> vecExitCFGLoopCount;
-        static std::vector<std::string> vecExitCFGLoopFuncNames;
+        static backedges::MetricSeries<int> exitCFGLoopCounts;
         static char ID; // Pass identification, replacement for typeid
         
         LoopExitCFGCount() :  FunctionPass(ID) {}
@@ -629,463 +1024,62 @@ namespace
         void getAnalysisUsage(AnalysisUsage &AU) const override
         {
             AU.setPreservesCFG();
-            AU.addRequired<LoopInfoWrapperPass>();
+            AU.addRequired<LoopStatsWrapperPass>();
         }
         
-        /*void getLoopCountNested(const Loop &Toploop, int &loopExitCounter) const
+        // counts the blocks that exit their innermost loop, the exact per loop exit edges
+        // are kept in LoopCounts::numExitEdges
+        void getLoopExitCount(const Function& func) const
         {
-            std::vector<Loop *> nestedloops = Toploop.getSubLoops();
-            
-            for (Loop::iterator iter = nestedloops.begin(); iter != nestedloops.end(); ++iter)
-            {
-                Loop *loop =*iter;
-                for(Loop::block_iterator bIter = loop->block_begin(); bIter != loop->block_end(); ++bIter)
-                {
-                    const BasicBlock *loopBlock = *bIter;
-                    if(loop->isLoopExiting(loopBlock))
-                    {
-                        loopExitCounter++;
-                        getLoopCountNested(*loop, loopExitCounter);
-                    }
-                }
-            }
-        }*/
+            const backedges::LoopStats &stats = getAnalysis<LoopStatsWrapperPass>().getStats();
+            HelperFunctions::record(exitCFGLoopCounts, func, stats.numInnermostExitingBlocks);
+        }
         
-        void getLoopExitCount(const Function& func) const
+        bool doInitialization(Module &M) override
         {
-            LoopInfo &loopInfo = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-            int loopExitCounter = 0;
-            /*for (Loop::iterator iter = loopInfo.begin(); iter != loopInfo.end(); ++iter)
-            {
-                Loop *loop = *iter;
-                for(Loop::block_iterator bIter = loop->block_begin(); bIter != loop->block_end(); ++bIter)
-                {
-                    const BasicBlock *loopBlock = *bIter;
-                    
-                    if(loop->isLoopExiting(loopBlock))
-                    {
-                        loopExitCounter++;
-                    }
-                    getLoopCountNested(*loop, loopExitCounter);
-                }
-            }*/ //Result is coming out too low with out nested at 26 and too high with at 227
-            
-            for (Function::const_iterator iter = func.begin(); iter != func.end(); ++iter) {
-                const BasicBlock &currBlock = *iter;
-                Loop *loop = loopInfo.getLoopFor(&currBlock);
-                if (loop != nullptr && loop->isLoopExiting(&currBlock))
-                {
-                    loopExitCounter++;
-                }
-            }
-            
-            vecExitCFGLoopCount.push_back(loopExitCounter);
-            vecExitCFGLoopFuncNames.push_back(func.getName());
+            HelperFunctions::startSeries(exitCFGLoopCounts, "LoopExitCFGCount");
+            return false;
         }
         
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecExitCFGLoopCount, vecExitCFGLoopFuncNames, "LoopExitCFGCount", true, false);
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteJson(exitCFGLoopCounts, "LoopExitCFGCount", true, false) << "\n";
             return false;
         }
     };
 }
 
 
-std::vector<int> LoopExitCFGCount::vecExitCFGLoopCount;
-std::vector<std::string> LoopExitCFGCount::vecExitCFGLoopFuncNames;
+backedges::MetricSeries<int> LoopExitCFGCount::exitCFGLoopCounts;
 char LoopExitCFGCount::ID = 0;
-static RegisterPass<LoopExitCFGCount>
-E("exitcfgloops", "counts loop exit CFG edges.");
-
-namespace
-{
-    typedef std::map<const BasicBlock *, std::map<const BasicBlock *, int> > matBasicBlocks;
-    typedef std::map<const BasicBlock *, std::map<const BasicBlock *, const BasicBlock *> > matSucBasicBlocks;
-    typedef std::vector<const BasicBlock *> basicBlockPath;
-    ///3.2 Using the cycles detected, determine the number of single entry loops as well as multi-entry loop.
-    
-    //ex. A loop is a cycle characterized by the entry point. For example, if a cycle is entered at two different points
-    // (multi-entry), it is to be counted as two separate loops.
-    
-    // part 2: compare the time taken for your algorithm with that the originally
-    // implemented dominator based single entry loop detector
-    
-    // part 3: Also compare the number of additional loops detected by your algorithm vs the dominator based one
-    //  part 4: Is Mr. Compiler justified in changing the loop detector?
-    struct Warshall3_2 : public FunctionPass
-    {
-        static char ID; // Pass identification, replacement for typeid
-        const int infinity = SHRT_MAX;
-        const int minValue = 1;
-        static std::vector<int> vecWarshallCounts;
-        static std::vector<std::string> vecWarshallFuncName;
-        Warshall3_2() :  FunctionPass(ID) {}
-        virtual ~Warshall3_2() {}
-        
-        bool runOnFunction(Function &F) override
-        {
-            errs() << F.getName() <<":\n";
-            matBasicBlocks dist;
-            matSucBasicBlocks next;
-            warhsalAlgo(F, dist, next);
-            pathReconstruction(F, dist, next);
-            return false;
-        }
-        
-        void printMap(matBasicBlocks &aMap)
-        {
-            for (auto& t : aMap)
-            {
-                for (auto& tt : t.second)
-                {
-                    if(tt.second == SHRT_MAX)
-                        errs() << "INF ";
-                    else
-                        errs() << " " << tt.second << "  ";
-                }
-                errs() << "\n";
-            }
-        }
-        
-        void printMap(matSucBasicBlocks &aMap)
-        {
-            
-            for (auto& t : aMap)
-            {
-                (t.first)->printAsOperand(errs(), false);
-                errs() << ": ";
-                for (auto& tt : t.second)
-                {
-                    if(tt.second == nullptr)
-                    {
-                        errs() << "NULL ";
-                    }
-                    else
-                    {
-                        errs() << " ";
-                        (tt.second)->printAsOperand(errs(), false);
-                        errs() << "  ";
-                    }
-                }
-                errs() << "\n";
-            }
-        }
-        void printMapPointer(matSucBasicBlocks &aMap)
-        {
-            for (auto& t : aMap)
-            {
-                for (auto& tt : t.second)
-                {
-                    if(tt.second == nullptr)
-                    {
-                        errs() << "nullptr        ";
-                    }
-                    else
-                    {
-                       errs() << tt.second << "  ";
-                    }
-                }
-                errs() << "\n";
-            }
-        }
-        
-        void printVector(basicBlockPath &avector)
-        {
-            errs() << "[";
-            for (auto v = avector.begin(); v != avector.end(); ++v)
-            {
-                (*v)->printAsOperand(errs(), false);
-                errs() << " ";
-            }
-            errs() << "]\n";
-        }
-        /*
-         https://en.wikipedia.org/wiki/Floyd%E2%80%93Warshall_algorithm#Path_reconstruction
-        procedure Path(u, v)
-            if next[u][v] = null then
-                return []
-            path = [u]
-            while u ≠ v
-                u ← next[u][v]
-                path.append(u)
-            return path
-        */
-        basicBlockPath Path(const BasicBlock *u, const BasicBlock *v, matSucBasicBlocks &next)
-        {
-            if(next[u][v] == nullptr)
-            {
-                return basicBlockPath();
-            }
-            basicBlockPath path;
-            path.push_back(u);
-            const BasicBlock *u_inc = u;
-            while(u_inc != v)
-            {
-                u_inc = next[u_inc][v];
-                path.push_back(u_inc);
-            }
-            return path;
-        }
-        
-        basicBlockPath mergePaths(const basicBlockPath &vuPath,const basicBlockPath &uvPath)
-        {
-            basicBlockPath concatPath;
-            if(vuPath.size() > 0)
-            {
-                concatPath.insert(concatPath.end(), vuPath.begin(), vuPath.end());
-            }
-            if(vuPath.size() > 0)
-            {
-                if(concatPath.back() == uvPath.front())
-                {
-                    concatPath.pop_back();
-                }
-                
-                concatPath.insert(concatPath.end(), uvPath.begin(), uvPath.end());
-            }
-            return concatPath;
-        }
-        
-        std::string getPathHash(const basicBlockPath &path)
-        {
-            std::stringstream ss;
-            for (auto v = path.begin(); v != path.end(); ++v)
-            {
-                 ss << *v << " ";
-            }
-            return ss.str();
-        }
-        
-        int LoopCounter(Function &func, basicBlockPath &path, std::map<std::string,bool> &seenPathsPred)
-        {
-            DominatorTree *DomTree = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
-            int iLoopCounter = 0;
-            for (auto node = path.begin(); node != path.end(); ++node)
-            {
-                const BasicBlock* searchNode = *node;
-                for (Function::const_iterator iter = func.begin(); iter != func.end(); ++iter)
-                {
-                    const BasicBlock &currBlock = *iter;
-                    if(std::find(path.begin(), path.end(), &currBlock) == path.end())
-                    {
-                        const TerminatorInst *termInst = currBlock.getTerminator();
-                        for (unsigned int v_succIndex = 0; v_succIndex < termInst->getNumSuccessors(); v_succIndex++)
-                        {
-                             const BasicBlock *v_succ = termInst->getSuccessor(v_succIndex);
-                            if(v_succ == searchNode)
-                            {
-                                if (!DomTree->dominates(searchNode, &currBlock))
-                                {
-                                    basicBlockPath predList;
-                                    predList.push_back(&currBlock);
-                                    predList.push_back(searchNode);
-                                    std::string predListHash = getPathHash(predList);
-                                    //errs() << "\npath: " << predListHash << "\n";
-                                    
-                                    if(seenPathsPred.find(predListHash) == seenPathsPred.end())
-                                    {
-                                        errs() << "PredList added:\n [";
-                                        currBlock.printAsOperand(errs(), false);
-                                        errs() << " ";
-                                        searchNode->printAsOperand(errs(), false);
-                                        errs() << " ]\n";
-                                        seenPathsPred[predListHash] = true;
-                                        iLoopCounter++;
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            return iLoopCounter;
-        }
-        
-        bool areVectorsPermutations(basicBlockPath & path1, basicBlockPath & path2)
-        {
-            if(path1.size() != path2.size())
-            {
-                return false;
-            }
-            for(size_t i = 0; i < path1.size(); i++)
-            {
-                bool bExists = false;
-                for(size_t j = 0; j < path2.size(); j++)
-                {
-                    if(path1[i] == path2[j])
-                    {
-                        bExists =  true;
-                        break;
-                    }
-                }
-                if (bExists == false)
-                {
-                    return false;
-                }
-            }
-            
-            return true;
-        }
+static RegisterPass<LoopExitCFGCount>
+E("exitcfgloops", "counts loop exit CFG edges.");
+
+namespace
+{
+    ///3.2 Using the cycles detected, determine the number of single entry loops as well as multi-entry loop.
+    
+    //ex. A loop is a cycle characterized by the entry point. For example, if a cycle is entered at two different points
+    // (multi-entry), it is to be counted as two separate loops.
+    
+    // part 2: compare the time taken for your algorithm with that the originally
+    // implemented dominator based single entry loop detector
+    
+    // part 3: Also compare the number of additional loops detected by your algorithm vs the dominator based one
+    //  part 4: Is Mr. Compiler justified in changing the loop detector?
+    struct Warshall3_2 : public FunctionPass
+    {
+        static char ID; // Pass identification, replacement for typeid
+        static backedges::MetricSeries<int> warshallCounts;
+        Warshall3_2() :  FunctionPass(ID) {}
+        virtual ~Warshall3_2() {}
         
-        void pathReconstruction(Function &func, matBasicBlocks &dist, matSucBasicBlocks &next)
+        bool runOnFunction(Function &F) override
         {
-            int iLoopCounter = 0;
-            std::map<std::string,bool> seenPathCombos;
-            std::map<std::string,bool> seenPathsPred;
-            std::vector<basicBlockPath> seenPaths;
-            for (Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
-            {
-                const BasicBlock *v_Block = &*v_iter;
-                for (Function::const_iterator u_iter = func.begin(); u_iter != func.end(); ++u_iter)
-                {
-                    const BasicBlock *u_Block = &*u_iter;
-                    
-                    if (dist[v_Block][u_Block] == infinity || //skip non-weighted path
-                        dist[u_Block][v_Block] == infinity ||
-                        dist[v_Block][u_Block] == 0        || // skip [v][v]
-                        dist[u_Block][v_Block] == 0)
-                    {
-                        continue;
-                    }
-                    basicBlockPath vuPath = Path(v_Block, u_Block, next);
-                    basicBlockPath uvPath = Path(u_Block, v_Block, next);
-                    basicBlockPath path = mergePaths(vuPath, uvPath);
-                    std::string pathHash = getPathHash(path);
-                    
-                    //errs() << "\npath before edit:\n";
-                    //printVector(path);
-                    if(seenPathCombos.find(pathHash) == seenPathCombos.end())
-                    {
-                        seenPathCombos[pathHash] = true;
-                        
-                        if(path.front() == path.back())
-                        {
-                            
-                            path.pop_back(); // we found a cycle make it a-cyclic
-                            bool addToSeenPaths = true;
-                            for (auto seenPathIter = seenPaths.begin(); seenPathIter != seenPaths.end(); ++seenPathIter)
-                            {
-                                basicBlockPath seenPath =*seenPathIter;
-                                if(areVectorsPermutations(seenPath,path))
-                                {
-                                    addToSeenPaths = false;
-                                }
-                                
-                            }
-                            if(addToSeenPaths)
-                            {
-                                errs() << "\nnew path found:\n";
-                                printVector(path);
-                                seenPaths.push_back(path);
-                                iLoopCounter += LoopCounter(func, path, seenPathsPred);
-                            }
-                        }
-                        else
-                        {
-                            errs() << "path does not have a cycle exiting loop";
-                        }
-                        
-                    }
-                }
-            }
-            vecWarshallCounts.push_back(iLoopCounter);
-            vecWarshallFuncName.push_back(func.getName());
-            //errs() << "Loop Count: " << iLoopCounter << "\n";
-        }
-        
-        void warhsalAlgo(Function &func, matBasicBlocks &dist, matSucBasicBlocks &next)
-        {
-            /*
-             https://en.wikipedia.org/wiki/Floyd%E2%80%93Warshall_algorithm
-             1 let dist be a |V| × |V| array of minimum distances initialized to ∞ (infinity)
-             2 for each vertex v
-             3    dist[v][v] ← 0
-             4 for each edge (u,v)
-             5    dist[u][v] ← w(u,v)  // the weight of the edge (u,v)
-             6 for k from 1 to |V|
-             7    for i from 1 to |V|
-             8       for j from 1 to |V|
-             9          if dist[i][j] > dist[i][k] + dist[k][j]
-             10             dist[i][j] ← dist[i][k] + dist[k][j]
-             11         end if
-             */
-            
-            
-            // initialized dist to ∞ (infinity)
-            for (Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
-            {
-                const BasicBlock *v_Block = &*v_iter;
-                for (Function::const_iterator u_iter = func.begin(); u_iter != func.end(); ++u_iter)
-                {
-                    const BasicBlock *u_Block = &*u_iter;
-                    dist[v_Block][u_Block] = infinity;
-                    
-                    // note: for path recon
-                    //let next be a |V| × |V| array of vertex indices initialized to null
-                    next[v_Block][u_Block] = nullptr;
-                }
-            }
-            //errs() << "init to int max: \n";
-            //printMap(dist);
-            
-            //4-5
-            for (Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
-            {
-                const BasicBlock *v_Block = &*v_iter;
-                const TerminatorInst *termInst = v_Block->getTerminator();
-                for (unsigned int v_succIndex = 0; v_succIndex < termInst->getNumSuccessors(); v_succIndex++)
-                {
-                    const BasicBlock *v_succ = termInst->getSuccessor(v_succIndex);
-                    dist[v_Block][v_succ] = minValue;
-                    
-                    //  note: path Recon next[u][v] ← v
-                    next[v_Block][v_succ] = v_succ;
-                }
-            }
-            
-            //errs() << "add min path weights:\n";
-            //printMap(dist);
-            
-            //line 2-3
-            for (Function::const_iterator v_iter = func.begin(); v_iter != func.end(); ++v_iter)
-            {
-                const BasicBlock *v_Block = &*v_iter;
-                dist[v_Block][v_Block] = 0;
-            }
-            
-            //errs() << "0 out [v][v]:\n";
-            //printMap(dist);
-            
-            //line 6-11
-            for (Function::const_iterator k_iter = func.begin(); k_iter != func.end(); ++k_iter)
-            {
-                const BasicBlock *k_Block = &*k_iter;
-                for (Function::const_iterator i_iter = func.begin(); i_iter != func.end(); ++i_iter)
-                {
-                    const BasicBlock *i_Block = &*i_iter;
-                    for (Function::const_iterator j_iter = func.begin(); j_iter != func.end(); ++j_iter)
-                    {
-                        const BasicBlock *j_Block = &*j_iter;
-                        if (dist[i_Block][j_Block] > dist[i_Block][k_Block] + dist[k_Block][j_Block])
-                        {
-                            dist[i_Block][j_Block] = dist[i_Block][k_Block] + dist[k_Block][j_Block];
-                            
-                            // note: path Recon next[i][j] ← next[i][k]
-                            next[i_Block][j_Block] = next[i_Block][k_Block];
-                            
-                        }
-                    }
-                }
-            }
-            errs() << "Warshall graph:\n";
-            printMap(dist);
-            
-            errs() << "Warshall next graph:\n";
-            printMap(next);
-            //errs() << "Warshall next graph pointers:\n";
-            //printMapPointer(next);
+            errs() << F.getName() <<":\n";
+            DominatorTree &DomTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+            backedges::WarshallLoopDetector detector(DomTree, errs(), true);
+            HelperFunctions::record(warshallCounts, F, detector.countLoops(F));
+            return false;
         }
         
         void getAnalysisUsage(AnalysisUsage &AU) const override
@@ -1094,17 +1088,21 @@ namespace
             AU.setPreservesAll();
         }
         
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(warshallCounts, "WarshLoopCount");
+            return false;
+        }
+        
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecWarshallCounts, vecWarshallFuncName, "WarshLoopCount", true, false);
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteJson(warshallCounts, "WarshLoopCount", true, false) << "\n";
             return false;
         }
     };
 }
 
 char Warshall3_2::ID = 0;
-std::vector<int> Warshall3_2::vecWarshallCounts;
-std::vector<std::string> Warshall3_2::vecWarshallFuncName;
+backedges::MetricSeries<int> Warshall3_2::warshallCounts;
 static RegisterPass<Warshall3_2>
 F("warshloopdetector", "counts loop using warshall.");
 
@@ -1119,8 +1117,7 @@ namespace
     //     clarify:  j post-dominates one of the successors of i but not the other one
     struct ControlDependence  : public FunctionPass
     {
-        static std::vector<int> vecCount;
-        static std::vector<std::string> vecFuncNames;
+        static backedges::MetricSeries<int> controlDependenceCounts;
         static char ID; // Pass identification, replacement for typeid
         
         ControlDependence() :  FunctionPass(ID) {}
@@ -1193,8 +1190,7 @@ namespace
                     }
                 }
             }
-            vecCount.push_back(controlDependenceCount);
-            vecFuncNames.push_back(func.getName());
+            HelperFunctions::record(controlDependenceCounts, func, controlDependenceCount);
             printMap(postDominateMap);
             errs() << "\n";
         }
@@ -1205,17 +1201,21 @@ namespace
             AU.setPreservesAll();
         }
 
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(controlDependenceCounts, "ControlDependence");
+            return false;
+        }
+        
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecCount, vecFuncNames, "ControlDependence", true, false);
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteJson(controlDependenceCounts, "ControlDependence", true, false) << "\n";
             return false;
         }
     };
 }
 
 
-std::vector<int> ControlDependence::vecCount;
-std::vector<std::string> ControlDependence::vecFuncNames;
+backedges::MetricSeries<int> ControlDependence::controlDependenceCounts;
 char ControlDependence::ID = 0;
 static RegisterPass<ControlDependence>
 G("controldep", "find a basicblock predicate's that decide the direction of the branch ");
@@ -1225,8 +1225,7 @@ namespace
     //3.4 this function returns true if there exists a directed path from basic block A to B, false otherwise.
     struct ReachablePass  : public FunctionPass
     {
-        static std::vector<int> vecCount;
-        static std::vector<std::string> vecFuncNames;
+        static backedges::MetricSeries<int> reachableCounts;
         static char ID; // Pass identification, replacement for typeid
         
         ReachablePass() :  FunctionPass(ID) {}
@@ -1321,8 +1320,7 @@ namespace
             errs() << "longest path: ";
             printList(longestPath);
             errs() << "End reachable analysis on "<< func.getName() <<"\n\n";
-            vecCount.push_back(nReachable);
-            vecFuncNames.push_back(func.getName());
+            HelperFunctions::record(reachableCounts, func, nReachable);
         }
         
         /*
@@ -1373,15 +1371,432 @@ namespace
             return std::vector<const BasicBlock*>();
         }
         
+        bool doInitialization(Module &M) override
+        {
+            HelperFunctions::startSeries(reachableCounts, "NodesReachable");
+            return false;
+        }
+        
         bool doFinalization(Module &M) override {
-            json j = HelperFunctions::createAndWriteJson(vecCount, vecFuncNames, "NodesReachable", true, false);
-            errs() << j.dump() <<"\n";
+            errs() << HelperFunctions::createAndWriteJson(reachableCounts, "NodesReachable", true, false) << "\n";
             return false;
         }
     };
 }
-std::vector<int> ReachablePass::vecCount;
-std::vector<std::string> ReachablePass::vecFuncNames;
+backedges::MetricSeries<int> ReachablePass::reachableCounts;
 char ReachablePass::ID = 0;
 static RegisterPass<ReachablePass>
 H("reachable", "find reachability from A to B");
+
+namespace
+{
+    // The series of every metric in AllMetrics, filled a function at a time and reported
+    // together. Each metric still gets its testResults/<CountName>.json; the summaries also go
+    // together into testResults/AllStats.json and one line on errs().
+    class AllStatsSeries
+    {
+    public:
+        void start()
+        {
+            StartSeries start = {this, 0};
+            backedges::AllMetrics().forEach(start);
+        }
+        
+        // values in the order of AllMetrics
+        void record(const Function &func, const std::vector<int> &values)
+        {
+            RecordResult record = {this, func, static_cast<double>(func.size()), values, 0};
+            backedges::AllMetrics().forEach(record);
+        }
+        
+        void report()
+        {
+            Report report = {this, {}, 0};
+            backedges::AllMetrics().forEach(report);
+            std::sort(report.summaries.begin(), report.summaries.end(),
+                      [](const backedges::MetricSummary &a, const backedges::MetricSummary &b)
+            {
+                return a.countName < b.countName;
+            });
+            writeSummaries(errs(), report.summaries, 0);
+            errs() << "\n";
+            std::error_code EC;
+            raw_fd_ostream o("testResults/AllStats.json", EC, sys::fs::F_Text);
+            if (!EC)
+            {
+                writeSummaries(o, report.summaries, 4);
+                o << "\n";
+            }
+        }
+        
+    private:
+        backedges::MetricSeries<int> counts[backedges::AllMetrics::size];
+        // only filled for the metrics that report per block
+        backedges::MetricSeries<double> byBlock[backedges::AllMetrics::size];
+        
+        // {"<CountName>":{summary},...}
+        static void writeSummaries(raw_ostream &os, const std::vector<backedges::MetricSummary> &summaries,
+                                   unsigned indent)
+        {
+            backedges::JsonStreamWriter writer(os, indent);
+            writer.beginObject();
+            for (const backedges::MetricSummary &summary : summaries)
+            {
+                writer.key(summary.countName);
+                summary.write(writer);
+            }
+            writer.endObject();
+        }
+        
+        // the visitors walk the metrics in list order, index is the metric's place in it
+        struct StartSeries
+        {
+            AllStatsSeries *series;
+            unsigned index;
+            
+            template <typename Metric>
+            void operator()(const Metric &)
+            {
+                HelperFunctions::startSeries(series->counts[index], Metric::countName());
+                if (Metric::PerBlock)
+                {
+                    HelperFunctions::startSeries(series->byBlock[index]);
+                }
+                index++;
+            }
+        };
+        
+        struct RecordResult
+        {
+            AllStatsSeries *series;
+            const Function &func;
+            double numBlocks;
+            const std::vector<int> &values;
+            unsigned index;
+            
+            template <typename Metric>
+            void operator()(const Metric &)
+            {
+                int value = values[index];
+                if (Metric::PerBlock)
+                {
+                    HelperFunctions::recordDominators(series->counts[index], series->byBlock[index], func,
+                                                      value, value / numBlocks);
+                }
+                else
+                {
+                    HelperFunctions::record(series->counts[index], func, value);
+                }
+                index++;
+            }
+        };
+        
+        struct Report
+        {
+            AllStatsSeries *series;
+            std::vector<backedges::MetricSummary> summaries;
+            unsigned index;
+            
+            template <typename Metric>
+            void operator()(const Metric &)
+            {
+                if (Metric::PerBlock)
+                {
+                    summaries.push_back(HelperFunctions::createAndWriteDominatorJson(series->counts[index],
+                                                                                     series->byBlock[index],
+                                                                                     Metric::countName()));
+                }
+                else
+                {
+                    summaries.push_back(HelperFunctions::createAndWriteJson(series->counts[index], Metric::countName(),
+                                                                            Metric::Summation, Metric::Minimum,
+                                                                            Metric::Average));
+                }
+                index++;
+            }
+        };
+    };
+}
+
+namespace
+{
+    // Every metric above from one walk over each function: the blocks with their edges, then
+    // the loop forest, with the CFG index, loop forest and dominator trees built once and
+    // shared. Loops always come from LoopInfo, -loop-tier does not apply here.
+    struct AllStatsPass : public FunctionPass
+    {
+        static AllStatsSeries series;
+        static char ID; // Pass identification, replacement for typeid
+        AllStatsPass() : FunctionPass(ID) {}
+        virtual ~AllStatsPass() {}
+        
+        bool runOnFunction(Function &F) override
+        {
+            uint64_t hash = 0;
+            std::vector<int> values;
+            if (metadata)
+            {
+                hash = backedges::structuralHash(F);
+                if (metadata->lookup(F, hash, backedges::MetricMetadata::AllMask, values))
+                {
+                    series.record(F, values);
+                    return false;
+                }
+            }
+            backedges::IndexedCFG cfg(F);
+            backedges::LoopForest forest(getAnalysis<LoopInfoWrapperPass>().getLoopInfo(), cfg);
+            DominatorTree &domTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+            backedges::DomTreeView dominators = DomEngine == backedges::DomEngineKind::SemiNCA
+                ? backedges::dominatorsFromLLVM(domTree, cfg)
+                : backedges::buildDominators(cfg, DomEngine);
+            backedges::FunctionView view = {cfg, forest, dominators, domTree,
+                                            getAnalysis<PostDominatorTreeWrapperPass>().getPostDomTree(), nullptr};
+            backedges::AllMetrics metrics;
+            if (DedupShapes)
+            {
+                backedges::measureDeduplicated(metrics, view, shapeMemo());
+            }
+            else
+            {
+                backedges::measureFunction(metrics, view);
+            }
+            values.clear();
+            values.reserve(backedges::AllMetrics::size);
+            backedges::CollectResults collect = {values};
+            metrics.forEach(collect);
+            series.record(F, values);
+            if (metadata)
+            {
+                metadata->update(F, hash, backedges::MetricMetadata::AllMask, values);
+                return true;
+            }
+            return false;
+        }
+        
+        void getAnalysisUsage(AnalysisUsage &AU) const override
+        {
+            AU.addRequired<LoopInfoWrapperPass>();
+            AU.addRequired<DominatorTreeWrapperPass>();
+            AU.addRequired<PostDominatorTreeWrapperPass>();
+            AU.setPreservesAll();
+        }
+        
+        bool doInitialization(Module &M) override
+        {
+            series.start();
+            if (StatsMetadata)
+            {
+                metadata.reset(new backedges::MetricMetadata());
+            }
+            return false;
+        }
+        
+        bool doFinalization(Module &M) override {
+            series.report();
+            if (DedupShapes)
+            {
+                shapeMemo().printHitRates(errs());
+            }
+            if (metadata)
+            {
+                printMetadataStats(*metadata);
+                metadata.reset();
+            }
+            return false;
+        }
+        
+    private:
+        std::unique_ptr<backedges::MetricMetadata> metadata;
+    };
+}
+
+AllStatsSeries AllStatsPass::series;
+char AllStatsPass::ID = 0;
+static RegisterPass<AllStatsPass>
+I("allstats", "every metric from a single traversal per function.");
+
+// The new pass manager's side of the plugin: every metric is a cached function analysis,
+// the passes below only gather the results of a module and report them.
+llvm::AnalysisKey backedges::FunctionViewAnalysis::Key;
+llvm::AnalysisKey backedges::AllMetricsAnalysis::Key;
+
+namespace
+{
+    // -passes=<pass name>: a metric over the module, from MetricAnalysis<Metric>. The series
+    // are this run's own, so reporting before and after a transform gives two summaries.
+    template <typename Metric>
+    struct MetricReportPass : public PassInfoMixin<MetricReportPass<Metric>>
+    {
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            backedges::MetricSeries<int> counts;
+            backedges::MetricSeries<double> byBlock;
+            HelperFunctions::startSeries(counts, Metric::countName());
+            HelperFunctions::startSeries(byBlock);
+            std::unique_ptr<backedges::MetricMetadata> metadata(StatsMetadata ? new backedges::MetricMetadata()
+                                                                              : nullptr);
+            unsigned index = backedges::MetricIndex<Metric>::get();
+            std::vector<int> values;
+            for (Function &F : M)
+            {
+                if (F.isDeclaration())
+                {
+                    continue;
+                }
+                int count;
+                if (metadata)
+                {
+                    uint64_t hash = backedges::structuralHash(F);
+                    if (metadata->lookup(F, hash, 1u << index, values))
+                    {
+                        count = values[index];
+                    }
+                    else
+                    {
+                        count = FAM.getResult<backedges::MetricAnalysis<Metric>>(F).count;
+                        values.assign(backedges::AllMetrics::size, 0);
+                        values[index] = count;
+                        metadata->update(F, hash, 1u << index, values);
+                    }
+                }
+                else
+                {
+                    count = FAM.getResult<backedges::MetricAnalysis<Metric>>(F).count;
+                }
+                if (Metric::PerBlock)
+                {
+                    HelperFunctions::recordDominators(counts, byBlock, F, count,
+                                                      count / static_cast<double>(F.size()));
+                }
+                else
+                {
+                    HelperFunctions::record(counts, F, count);
+                }
+            }
+            // with -stats-async this is the only pass in flight, report() waits for the writer
+            if (Metric::PerBlock)
+            {
+                errs() << HelperFunctions::createAndWriteDominatorJson(counts, byBlock, Metric::countName()) << "\n";
+            }
+            else
+            {
+                errs() << HelperFunctions::createAndWriteJson(counts, Metric::countName(), Metric::Summation,
+                                                              Metric::Minimum, Metric::Average) << "\n";
+            }
+            if (DedupShapes)
+            {
+                shapeMemo().printHitRates(errs());
+            }
+            if (metadata)
+            {
+                printMetadataStats(*metadata);
+            }
+            // only metadata attachments changed, every analysis still holds
+            return PreservedAnalyses::all();
+        }
+    };
+    
+    // -passes=allstats
+    struct AllStatsReportPass : public PassInfoMixin<AllStatsReportPass>
+    {
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            AllStatsSeries series;
+            series.start();
+            std::unique_ptr<backedges::MetricMetadata> metadata(StatsMetadata ? new backedges::MetricMetadata()
+                                                                              : nullptr);
+            std::vector<int> values;
+            for (Function &F : M)
+            {
+                if (F.isDeclaration())
+                {
+                    continue;
+                }
+                if (!metadata)
+                {
+                    series.record(F, FAM.getResult<backedges::AllMetricsAnalysis>(F).counts);
+                    continue;
+                }
+                uint64_t hash = backedges::structuralHash(F);
+                if (!metadata->lookup(F, hash, backedges::MetricMetadata::AllMask, values))
+                {
+                    values = FAM.getResult<backedges::AllMetricsAnalysis>(F).counts;
+                    metadata->update(F, hash, backedges::MetricMetadata::AllMask, values);
+                }
+                series.record(F, values);
+            }
+            series.report();
+            if (DedupShapes)
+            {
+                shapeMemo().printHitRates(errs());
+            }
+            if (metadata)
+            {
+                printMetadataStats(*metadata);
+            }
+            return PreservedAnalyses::all();
+        }
+    };
+    
+    struct RegisterAnalyses
+    {
+        FunctionAnalysisManager &FAM;
+        
+        template <typename Metric>
+        void operator()(const Metric &)
+        {
+            FAM.registerPass([]() { return backedges::MetricAnalysis<Metric>(); });
+        }
+    };
+    
+    struct ParsePipelineElement
+    {
+        StringRef name;
+        ModulePassManager &MPM;
+        bool parsed;
+        
+        template <typename Metric>
+        void operator()(const Metric &)
+        {
+            if (!parsed && name == Metric::passName())
+            {
+                MPM.addPass(MetricReportPass<Metric>());
+                parsed = true;
+            }
+        }
+    };
+    
+    void registerCallbacks(PassBuilder &PB)
+    {
+        PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM)
+        {
+            FAM.registerPass([]()
+            {
+                return backedges::FunctionViewAnalysis(DomEngine, DedupShapes ? &shapeMemo() : nullptr);
+            });
+            FAM.registerPass([]() { return backedges::AllMetricsAnalysis(); });
+            RegisterAnalyses registerAnalyses = {FAM};
+            backedges::AllMetrics().forEach(registerAnalyses);
+        });
+        PB.registerPipelineParsingCallback([](StringRef name, ModulePassManager &MPM,
+                                              ArrayRef<PassBuilder::PipelineElement>)
+        {
+            if (name == "allstats")
+            {
+                MPM.addPass(AllStatsReportPass());
+                return true;
+            }
+            ParsePipelineElement parse = {name, MPM, false};
+            backedges::AllMetrics().forEach(parse);
+            return parse.parsed;
+        });
+    }
+}
+
+// opt -load-pass-plugin=LLVMBackEdges.so -passes=basicblock,allstats
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo()
+{
+    return {LLVM_PLUGIN_API_VERSION, "BackEdges", LLVM_VERSION_STRING, registerCallbacks};
+}
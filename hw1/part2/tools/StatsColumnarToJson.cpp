@@ -0,0 +1,108 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+// Turns a testResults/<CountName>.stats.bin written with -stats-columnar back into the
+// testResults/<CountName>.json the pass writes. The summary is recomputed from the columns in
+// file order with the options recorded in the header, so the output matches byte for byte.
+//
+//   statsbin2json testResults/BasicBlockCount.stats.bin [-o BasicBlockCount.json]
+
+#include "ColumnarStats.h"
+#include "MetricSummary.h"
+#include "StatsAccumulator.h"
+#include "StatsShard.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+
+using namespace llvm;
+using namespace backedges;
+
+static cl::opt<std::string> Input(cl::Positional, cl::desc("<stats.bin>"), cl::Required);
+static cl::opt<std::string> Output("o", cl::desc("Output file, - for stdout"), cl::value_desc("file"),
+                                   cl::init("-"));
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "convert -stats-columnar output to the JSON results layout\n");
+
+    std::string error;
+    std::unique_ptr<ColumnarStatsFile> file = ColumnarStatsFile::open(Input, error);
+    if (!file)
+    {
+        errs() << Input << ": " << error << "\n";
+        return 1;
+    }
+
+    std::string countName = file->countName().str();
+    ArrayRef<uint32_t> ids = file->functionNames();
+    ArrayRef<int32_t> values = file->column<int32_t>(countName);
+    ArrayRef<double> domPerBlock = file->column<double>("DomPerBlock");
+    // a column with no rows still has a place in the file, only a missing one maps to null
+    bool hasDomPerBlock = domPerBlock.data() != nullptr;
+
+    // the names point into the mapping, which outlives both series
+    MetricSeries<int> series;
+    MetricSeries<double> byBlock;
+    if (file->reports(ReportsExtended))
+    {
+        series.top.setLimit(file->topK());
+    }
+    if (file->reports(ReportsSketch))
+    {
+        series.sketch.enable();
+    }
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        series.add(file->name(ids[i]), values[i]);
+        if (hasDomPerBlock)
+        {
+            byBlock.add(file->name(ids[i]), domPerBlock[i]);
+        }
+    }
+
+    ShardMetric metric = shardMetricOf(series, countName, file->reports(ReportsSummation),
+                                       file->reports(ReportsMinimum), file->reports(ReportsAverage),
+                                       file->reports(ReportsExtended));
+    if (file->reports(ReportsTier))
+    {
+        metric.hasTier = true;
+        metric.irreducibleFunctions = file->irreducibleFunctions();
+    }
+    if (hasDomPerBlock)
+    {
+        metric.hasByBlock = true;
+        metric.byBlock = namedStats(byBlock.stats);
+    }
+
+    std::error_code EC;
+    raw_fd_ostream o(Output, EC, sys::fs::F_Text);
+    if (EC)
+    {
+        errs() << Output << ": " << EC.message() << "\n";
+        return 1;
+    }
+    auto name = [&](size_t i) { return file->name(ids[i]); };
+    auto value = [&](size_t i) { return values[i]; };
+    auto dom = [&](size_t i) { return domPerBlock[i]; };
+    ResultRows rows = {ids.size(), name, value, hasDomPerBlock, dom};
+    writeResultsJson(o, metric.summarize(), &rows);
+    return 0;
+}
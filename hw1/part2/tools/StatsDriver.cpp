@@ -0,0 +1,1181 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+// Everything runPass.sh gets out of twelve opt runs, from one: the bitcode is mapped and
+// parsed once, then the requested metrics run over the functions on a work stealing pool,
+// biggest functions first. Results are put back in function order before they are summarized,
+// so the testResults/<CountName>.json files match the plugin's for any number of threads.
+//
+// Given several files, a directory of *.bc files or -input-list, the driver runs in batch
+// mode instead: whole modules go to the pool, biggest file first, and every worker loads its
+// modules lazily into its own LLVMContext, materializing the bodies it measures one at a
+// time. Results are aggregated over all the modules, in input order, with the functions
+// named file:function.
+//
+// Either way -stream-window=N bounds memory on huge modules: bodies are materialized N at a
+// time and freed as soon as they are measured, only the compact per function results are
+// kept. On one module -parallel-parse moves the body parsing onto the pool as well, so a big
+// module no longer waits on a single thread to read it. Wall time, CPU time, throughput, the
+// time to the first result and peak RSS go to stderr.
+//
+// With -cache-dir the values survive the run: functions are looked up by a structural hash
+// of their code, salted with the metrics version and options, and only the ones the cache
+// does not know are analyzed. See FunctionCache.h for how the index is kept. -dedup-shapes
+// does the same within a run for the metrics that only depend on the CFG, by CFG shape.
+//
+// -delta-base compares two builds of a module instead. Functions are paired by name and
+// structural hash; only the ones added or changed in the patched build are analyzed, both
+// sides of a changed one, and testResults/Delta.json lists what each metric did for them.
+//
+//   statsdriver [-j=N] [-passes=basicblock,cfgedge,...] [-results-dir=testResults] test1.bc
+//   statsdriver [-j=N] [-input-list=files.txt] nightly/ a.bc b.bc ...
+//   statsdriver [-j=N] -stream-window=64 lto.bc
+//   statsdriver [-j=N] -parallel-parse lto.bc
+//   statsdriver [-j=N] -cache-dir=~/.cache/backedges [-cache-size-mb=256] nightly/
+//   statsdriver [-j=N] -dedup-shapes lto.bc
+//   statsdriver [-j=N] -delta-base=base.bc patched.bc
+
+#include "CFGIndex.h"
+#include "DominatorEngines.h"
+#include "FunctionCache.h"
+#include "FusedMetrics.h"
+#include "LoopForest.h"
+#include "MetricSummary.h"
+#include "NameTable.h"
+#include "ShapeMemo.h"
+#include "ShardedResults.h"
+#include "StatsAccumulator.h"
+#include "StatsShard.h"
+#include "StructuralHash.h"
+#include "WorkStealingPool.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace llvm;
+using namespace backedges;
+
+static cl::list<std::string> Inputs(cl::Positional, cl::desc("<bitcode files or directories>"), cl::ZeroOrMore);
+static cl::opt<std::string> InputList("input-list", cl::desc("A file with one bitcode path per line"),
+                                      cl::value_desc("file"));
+static cl::opt<unsigned> Jobs("j", cl::desc("Worker threads, 0 uses every core"), cl::init(0));
+static cl::list<std::string> Passes("passes", cl::desc("Metrics to run, by pass name, all of them by default"),
+                                    cl::CommaSeparated, cl::value_desc("basicblock,cfgedge,..."));
+static cl::opt<std::string> ResultsDir("results-dir", cl::desc("Where the <CountName>.json files go"),
+                                       cl::value_desc("dir"), cl::init("testResults"));
+static cl::opt<DomEngineKind> DomEngine("dom-engine",
+    cl::desc("Dominator algorithm for the dominator metrics"),
+    cl::values(clEnumValN(DomEngineKind::CooperHarveyKennedy, "chk", "iterative Cooper-Harvey-Kennedy"),
+               clEnumValN(DomEngineKind::LengauerTarjan, "lt", "Lengauer-Tarjan with path compression"),
+               clEnumValN(DomEngineKind::SemiNCA, "snca", "LLVM's DominatorTree (Semi-NCA)")),
+    cl::init(DomEngineKind::SemiNCA));
+static cl::opt<unsigned> StreamWindow("stream-window",
+    cl::desc("Materialize this many function bodies at a time and free them once measured, "
+             "0 keeps the whole module in memory"),
+    cl::init(0));
+static cl::opt<std::string> CacheDir("cache-dir",
+    cl::desc("Keep every function's metrics in this directory, keyed by the function's structural hash, "
+             "and only analyze the functions it does not have"),
+    cl::value_desc("dir"));
+static cl::opt<unsigned> CacheSizeMB("cache-size-mb", cl::desc("Evict least recently used entries past this size"),
+                                     cl::init(256));
+static cl::opt<bool> DedupShapes("dedup-shapes",
+    cl::desc("Compute warshloopdetector, controldep and reachable once per CFG shape"));
+static cl::opt<bool> ParallelParse("parallel-parse",
+    cl::desc("Parse function bodies on every worker, each from its own lazy copy of the module"));
+static cl::opt<std::string> DeltaBase("delta-base",
+    cl::desc("Compare the input with this earlier build of it: only the functions added or changed since are "
+             "analyzed, and what moved goes to <results-dir>/Delta.json"),
+    cl::value_desc("base.bc"));
+
+namespace
+{
+    // what the report needs of a metric, in AllMetrics order
+    struct MetricInfo
+    {
+        const char *countName;
+        const char *passName;
+        bool summation;
+        bool minimum;
+        bool average;
+        bool perBlock;
+    };
+
+    struct DescribeMetrics
+    {
+        std::vector<MetricInfo> &metrics;
+
+        template <typename Metric>
+        void operator()(const Metric &)
+        {
+            MetricInfo info = {Metric::countName(), Metric::passName(), Metric::Summation, Metric::Minimum,
+                               Metric::Average, Metric::PerBlock};
+            metrics.push_back(info);
+        }
+    };
+
+    // the selected metrics one after the other over the shared view
+    struct MeasureSelected
+    {
+        const FunctionView &view;
+        const std::vector<bool> &selected;
+        std::vector<int> &values;
+        unsigned index;
+
+        template <typename Metric>
+        void operator()(const Metric &)
+        {
+            if (selected[index])
+            {
+                Metric metric;
+                measureFunction(metric, view);
+                values[index] = metric.result();
+            }
+            index++;
+        }
+    };
+
+    // One function's values, indexed like AllMetrics. The name is interned, a batch frees
+    // each module well before the report reads the names back.
+    struct FunctionResult
+    {
+        uint32_t nameId;
+        unsigned numBlocks;
+        std::vector<int> values;
+    };
+
+    // what every function is measured for
+    struct MeasureOptions
+    {
+        std::vector<bool> selected;
+        bool all;
+        // with -cache-dir: selected as bits, what a cached entry has to cover, and what the
+        // cached values depend on besides the function
+        FunctionCache *cache;
+        uint32_t cacheMask;
+        uint64_t cacheSalt;
+        // with -dedup-shapes
+        ShapeMemo *memo;
+    };
+
+    // Builds the trees the metrics look at, each thread for its own function. Nothing here
+    // writes to the IR, so functions of one module can be measured side by side.
+    FunctionResult analyze(Function &F, uint32_t nameId, const MeasureOptions &options)
+    {
+        FunctionResult result;
+        result.nameId = nameId;
+        result.numBlocks = F.size();
+        result.values.assign(AllMetrics::size, 0);
+
+        IndexedCFG cfg(F);
+        DominatorTree domTree(F);
+        LoopInfo loopInfo(domTree);
+        PostDominatorTree postDomTree(F);
+        LoopForest forest(loopInfo, cfg);
+        DomTreeView dominators = DomEngine == DomEngineKind::SemiNCA ? dominatorsFromLLVM(domTree, cfg)
+                                                                      : buildDominators(cfg, DomEngine);
+        FunctionView view = {cfg, forest, dominators, domTree, postDomTree, nullptr};
+        ShapeResults shapeResults;
+        std::unique_ptr<CanonicalShape> shape;
+        if (options.memo != nullptr)
+        {
+            shape.reset(new CanonicalShape(cfg, postDomTree));
+            options.memo->lookup(*shape, shapeResults);
+            view.shape = &shapeResults;
+        }
+        if (options.all)
+        {
+            AllMetrics metrics;
+            measureFunction(metrics, view);
+            result.values.clear();
+            CollectResults collect = {result.values};
+            metrics.forEach(collect);
+        }
+        else
+        {
+            MeasureSelected measureSelected = {view, options.selected, result.values, 0};
+            AllMetrics().forEach(measureSelected);
+        }
+        if (shape)
+        {
+            options.memo->store(*shape, shapeResults);
+        }
+        return result;
+    }
+
+    // analyze, unless the cache has the function's values from an earlier run
+    FunctionResult measure(Function &F, uint32_t nameId, const MeasureOptions &options)
+    {
+        if (options.cache == nullptr)
+        {
+            return analyze(F, nameId, options);
+        }
+        StableHash key;
+        key.add(structuralHash(F));
+        key.add(options.cacheSalt);
+        FunctionCacheEntry entry;
+        if (options.cache->lookup(key.get(), options.cacheMask, entry))
+        {
+            FunctionResult result = {nameId, entry.numBlocks,
+                                     std::vector<int>(entry.values, entry.values + AllMetrics::size)};
+            return result;
+        }
+        FunctionResult result = analyze(F, nameId, options);
+        entry = FunctionCacheEntry();
+        entry.key = key.get();
+        entry.numBlocks = result.numBlocks;
+        entry.mask = options.cacheMask;
+        std::copy(result.values.begin(), result.values.end(), entry.values);
+        options.cache->store(entry);
+        return result;
+    }
+
+    // the series of the selected metrics, filled in function order
+    class Report
+    {
+    public:
+        Report(const std::vector<MetricInfo> &metrics, const std::vector<bool> &selected)
+            : metrics(metrics), selected(selected), counts(metrics.size()), byBlock(metrics.size())
+        {
+            for (size_t index = 0; index < metrics.size(); index++)
+            {
+                counts[index].keepValues = true;
+                byBlock[index].keepValues = true;
+            }
+        }
+
+        void add(const FunctionResult &result)
+        {
+            StringRef name = NameTable::shared().name(result.nameId);
+            for (size_t index = 0; index < metrics.size(); index++)
+            {
+                if (!selected[index])
+                {
+                    continue;
+                }
+                int value = result.values[index];
+                if (metrics[index].perBlock)
+                {
+                    byBlock[index].add(name, value / static_cast<double>(result.numBlocks));
+                }
+                counts[index].add(name, value);
+            }
+        }
+
+        // a summary line per metric on errs(), like the passes print, and the results files
+        bool write()
+        {
+            if (sys::fs::create_directories(ResultsDir))
+            {
+                errs() << "cannot create " << ResultsDir << "\n";
+                return false;
+            }
+            bool ok = true;
+            for (size_t index = 0; index < metrics.size(); index++)
+            {
+                if (selected[index])
+                {
+                    ok &= write(index);
+                }
+            }
+            return ok;
+        }
+
+    private:
+        const std::vector<MetricInfo> &metrics;
+        const std::vector<bool> &selected;
+        std::vector<MetricSeries<int>> counts;
+        std::vector<MetricSeries<double>> byBlock;
+
+        bool write(size_t index)
+        {
+            const MetricInfo &info = metrics[index];
+            const MetricSeries<int> &series = counts[index];
+            ShardMetric metric = shardMetricOf(series, info.countName, info.summation, info.minimum, info.average,
+                                               false);
+            if (info.perBlock)
+            {
+                metric.hasByBlock = true;
+                metric.byBlock = namedStats(byBlock[index].stats);
+            }
+            MetricSummary summary = metric.summarize();
+            errs() << summary << "\n";
+
+            SmallString<128> path(ResultsDir);
+            sys::path::append(path, Twine(info.countName) + ".json");
+            std::error_code EC;
+            raw_fd_ostream o(path, EC, sys::fs::F_Text);
+            if (EC)
+            {
+                errs() << path << ": " << EC.message() << "\n";
+                return false;
+            }
+            o.SetBufferSize(1 << 16);
+            const NameTable &names = NameTable::shared();
+            const std::vector<FunctionRecord<double>> &domCount = byBlock[index].records;
+            auto name = [&](size_t i) { return names.name(series.records[i].nameId); };
+            auto value = [&](size_t i) { return series.records[i].value; };
+            auto domPerBlock = [&](size_t i) { return domCount[i].value; };
+            ResultRows rows = {series.records.size(), name, value, info.perBlock, domPerBlock};
+            writeResultsJson(o, summary, &rows);
+            return true;
+        }
+    };
+
+    bool selectMetrics(const std::vector<MetricInfo> &metrics, std::vector<bool> &selected)
+    {
+        selected.assign(metrics.size(), Passes.empty());
+        for (const std::string &pass : Passes)
+        {
+            auto found = std::find_if(metrics.begin(), metrics.end(), [&](const MetricInfo &info)
+            {
+                return pass == info.passName;
+            });
+            if (found == metrics.end())
+            {
+                errs() << "unknown pass " << pass << "\n";
+                return false;
+            }
+            selected[found - metrics.begin()] = true;
+        }
+        return true;
+    }
+
+    // A module read lazily from its mapped file. Bodies are parsed out of the mapping as
+    // they are materialized, so the mapping has to outlive the module.
+    struct LazyModule
+    {
+        std::unique_ptr<sys::fs::mapped_file_region> region;
+        std::unique_ptr<Module> module;
+    };
+
+    bool mapBitcode(const std::string &path, std::unique_ptr<sys::fs::mapped_file_region> &region,
+                    std::string &error)
+    {
+        uint64_t size;
+        int fd;
+        if (sys::fs::file_size(path, size) || sys::fs::openFileForRead(path, fd))
+        {
+            error = path + ": cannot open";
+            return false;
+        }
+        std::error_code EC;
+        region.reset(new sys::fs::mapped_file_region(fd, sys::fs::mapped_file_region::readonly, size, 0, EC));
+        sys::Process::SafelyCloseFileDescriptor(fd);
+        if (EC)
+        {
+            error = path + ": " + EC.message();
+            return false;
+        }
+        return true;
+    }
+
+    // the globals and where every body is, no bodies yet
+    bool parseLazily(const std::string &path, const sys::fs::mapped_file_region &region, LLVMContext &context,
+                     std::unique_ptr<Module> &module, std::string &error)
+    {
+        Expected<std::unique_ptr<Module>> parsed =
+            getLazyBitcodeModule(MemoryBufferRef(StringRef(region.const_data(), region.size()), path), context);
+        if (!parsed)
+        {
+            error = path + ": " + toString(parsed.takeError());
+            return false;
+        }
+        module = std::move(*parsed);
+        return true;
+    }
+
+    bool loadLazily(const std::string &path, LLVMContext &context, LazyModule &loaded, std::string &error)
+    {
+        return mapBitcode(path, loaded.region, error) &&
+               parseLazily(path, *loaded.region, context, loaded.module, error);
+    }
+
+    // directories contribute their *.bc files, the list file one path per line
+    bool collectInputs(std::vector<std::string> &paths)
+    {
+        std::vector<std::string> inputs(Inputs.begin(), Inputs.end());
+        if (!InputList.empty())
+        {
+            ErrorOr<std::unique_ptr<MemoryBuffer>> list = MemoryBuffer::getFile(InputList);
+            if (!list)
+            {
+                errs() << InputList << ": " << list.getError().message() << "\n";
+                return false;
+            }
+            SmallVector<StringRef, 64> lines;
+            (*list)->getBuffer().split(lines, '\n', -1, false);
+            for (StringRef line : lines)
+            {
+                line = line.trim();
+                if (!line.empty())
+                {
+                    inputs.push_back(line.str());
+                }
+            }
+        }
+        for (const std::string &input : inputs)
+        {
+            if (!sys::fs::is_directory(input))
+            {
+                paths.push_back(input);
+                continue;
+            }
+            std::vector<std::string> found;
+            std::error_code EC;
+            for (sys::fs::directory_iterator entry(input, EC), end; entry != end && !EC; entry.increment(EC))
+            {
+                if (sys::path::extension(entry->path()) == ".bc")
+                {
+                    found.push_back(entry->path());
+                }
+            }
+            if (EC)
+            {
+                errs() << input << ": " << EC.message() << "\n";
+                return false;
+            }
+            std::sort(found.begin(), found.end());
+            paths.insert(paths.end(), found.begin(), found.end());
+        }
+        return true;
+    }
+
+    // biggest first, ties in input order so the schedule is the same every run
+    std::vector<unsigned> biggestFirst(const std::vector<uint64_t> &weights)
+    {
+        std::vector<unsigned> order(weights.size());
+        for (unsigned index = 0; index < order.size(); index++)
+        {
+            order[index] = index;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b)
+        {
+            return weights[a] > weights[b];
+        });
+        return order;
+    }
+
+    // a function's instruction count, what the pool schedules by
+    uint64_t weightOf(const Function &F)
+    {
+        uint64_t instructions = 0;
+        for (const BasicBlock &block : F)
+        {
+            instructions += block.size();
+        }
+        return instructions;
+    }
+
+    double millisSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double cpuMillis()
+    {
+        sys::TimePoint<> elapsed;
+        std::chrono::nanoseconds user, system;
+        sys::Process::GetTimeUsage(elapsed, user, system);
+        return std::chrono::duration<double, std::milli>(user + system).count();
+    }
+
+    // the high water mark of the resident set, what -stream-window is meant to keep down
+    double peakRSSMegabytes()
+    {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+#ifdef __APPLE__
+        return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        return usage.ru_maxrss / 1024.0;
+#endif
+    }
+
+    // One module, its functions spread over the pool. The reader is not safe to call from
+    // several threads, so bodies are materialized between pool runs: all of them up front, or
+    // with -stream-window a window at a time, each window's bodies freed once it is measured.
+    bool measureModule(const std::string &path, unsigned threads, const MeasureOptions &options, Report &report)
+    {
+        auto start = std::chrono::steady_clock::now();
+        LLVMContext context;
+        LazyModule loaded;
+        std::string error;
+        if (!loadLazily(path, context, loaded, error))
+        {
+            errs() << error << "\n";
+            return false;
+        }
+        if (StreamWindow == 0)
+        {
+            if (Error E = loaded.module->materializeAll())
+            {
+                errs() << path << ": " << toString(std::move(E)) << "\n";
+                return false;
+            }
+        }
+        double parseMillis = millisSince(start);
+
+        // the definitions in module order, the order results are reported in
+        std::vector<Function *> functions;
+        for (Function &F : *loaded.module)
+        {
+            if (!F.isDeclaration())
+            {
+                functions.push_back(&F);
+            }
+        }
+        size_t window = StreamWindow != 0 ? StreamWindow : std::max<size_t>(1, functions.size());
+
+        double materializeMillis = 0;
+        double analysisMillis = 0;
+        double analysisCpuMillis = 0;
+        size_t steals = 0;
+        WorkStealingPool pool(threads);
+        ShardedResults<FunctionResult> results(pool.size());
+        double firstResultMillis = -1;
+        auto consume = [&](unsigned, const FunctionResult &result)
+        {
+            if (firstResultMillis < 0)
+            {
+                firstResultMillis = millisSince(start);
+            }
+            report.add(result);
+        };
+        for (size_t begin = 0; begin < functions.size(); begin += window)
+        {
+            size_t end = std::min(functions.size(), begin + window);
+            auto materializeStart = std::chrono::steady_clock::now();
+            std::vector<uint64_t> weights;
+            for (size_t index = begin; index < end; index++)
+            {
+                if (Error E = functions[index]->materialize())
+                {
+                    errs() << path << ": " << toString(std::move(E)) << "\n";
+                    return false;
+                }
+                weights.push_back(weightOf(*functions[index]));
+            }
+            materializeMillis += millisSince(materializeStart);
+            std::vector<unsigned> order = biggestFirst(weights);
+
+            auto analysisStart = std::chrono::steady_clock::now();
+            double cpuStart = cpuMillis();
+            pool.run(order.size(), [&](unsigned, size_t task)
+            {
+                unsigned index = begin + order[task];
+                Function &F = *functions[index];
+                results.add(index, measure(F, NameTable::shared().intern(F.getName()), options));
+            });
+            analysisMillis += millisSince(analysisStart);
+            analysisCpuMillis += cpuMillis() - cpuStart;
+            steals += pool.numSteals();
+            results.drainReady(consume);
+            if (StreamWindow != 0)
+            {
+                for (size_t index = begin; index < end; index++)
+                {
+                    functions[index]->deleteBody();
+                }
+            }
+        }
+        results.drainAll(consume);
+
+        errs() << "parsed " << path << " in " << format("%.1f", parseMillis) << " ms";
+        if (StreamWindow != 0)
+        {
+            errs() << ", bodies in " << format("%.1f", materializeMillis) << " ms, " << window << " at a time";
+        }
+        errs() << "; " << functions.size() << " functions on " << pool.size() << " threads in "
+               << format("%.1f", analysisMillis) << " ms wall, " << format("%.1f", analysisCpuMillis) << " ms CPU, "
+               << format("%.0f", functions.size() / (analysisMillis / 1000)) << " functions/s, "
+               << steals << " steals, first result after " << format("%.1f", firstResultMillis) << " ms\n";
+        return true;
+    }
+
+    // One module parsed by every worker at once. Each worker lazily loads its own copy of the
+    // module, into its own context, from the one mapping; that reads the globals and the body
+    // offsets only. Tasks are function indices, the same in every copy, and whoever runs one
+    // materializes that body in its own copy, so bodies are parsed on all threads with no
+    // reader shared between them. Body sizes are not known before they are parsed, so tasks
+    // go out in module order and stealing evens out the load.
+    bool measureModuleInParallel(const std::string &path, unsigned threads, const MeasureOptions &options,
+                                 Report &report)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<sys::fs::mapped_file_region> region;
+        std::string error;
+        if (!mapBitcode(path, region, error))
+        {
+            errs() << error << "\n";
+            return false;
+        }
+
+        WorkStealingPool pool(threads);
+        std::vector<std::unique_ptr<LLVMContext>> contexts;
+        std::vector<std::unique_ptr<Module>> copies(pool.size());
+        std::vector<std::vector<Function *>> functions(pool.size());
+        std::vector<std::string> errors(pool.size());
+        for (unsigned worker = 0; worker < pool.size(); worker++)
+        {
+            contexts.emplace_back(new LLVMContext());
+        }
+        // a copy per worker; whichever thread loads a copy, only its own worker uses it later
+        pool.run(pool.size(), [&](unsigned, size_t copy)
+        {
+            if (parseLazily(path, *region, *contexts[copy], copies[copy], errors[copy]))
+            {
+                for (Function &F : *copies[copy])
+                {
+                    if (!F.isDeclaration())
+                    {
+                        functions[copy].push_back(&F);
+                    }
+                }
+            }
+        });
+        for (const std::string &copyError : errors)
+        {
+            if (!copyError.empty())
+            {
+                errs() << copyError << "\n";
+                return false;
+            }
+        }
+        double loadMillis = millisSince(start);
+
+        size_t numFunctions = functions[0].size();
+        auto analysisStart = std::chrono::steady_clock::now();
+        double cpuStart = cpuMillis();
+        ShardedResults<FunctionResult> results(pool.size());
+        double firstResultMillis = -1;
+        auto consume = [&](unsigned, const FunctionResult &result)
+        {
+            if (firstResultMillis < 0)
+            {
+                firstResultMillis = millisSince(start);
+            }
+            report.add(result);
+        };
+        std::mutex errorLock;
+        bool failed = false;
+        pool.run(numFunctions, [&](unsigned worker, size_t task)
+        {
+            Function &F = *functions[worker][task];
+            if (Error E = F.materialize())
+            {
+                std::lock_guard<std::mutex> guard(errorLock);
+                errs() << path << ": " << toString(std::move(E)) << "\n";
+                failed = true;
+                return;
+            }
+            results.add(task, measure(F, NameTable::shared().intern(F.getName()), options));
+            if (StreamWindow != 0)
+            {
+                F.deleteBody();
+            }
+            results.drainReady(consume);
+        });
+        results.drainAll(consume);
+        double analysisMillis = millisSince(analysisStart);
+        double analysisCpuMillis = cpuMillis() - cpuStart;
+
+        errs() << "loaded " << pool.size() << " lazy copies of " << path << " in " << format("%.1f", loadMillis)
+               << " ms; " << numFunctions << " functions parsed and measured on " << pool.size() << " threads in "
+               << format("%.1f", analysisMillis) << " ms wall, " << format("%.1f", analysisCpuMillis) << " ms CPU, "
+               << format("%.0f", numFunctions / (analysisMillis / 1000)) << " functions/s, "
+               << pool.numSteals() << " steals, first result after " << format("%.1f", firstResultMillis) << " ms\n";
+        return !failed;
+    }
+
+    // a batch module's results, empty when it could not be read
+    typedef std::vector<FunctionResult> ModuleResults;
+
+    // a batch module, its bodies materialized only as they are measured and, streaming,
+    // freed right after
+    bool measureLazily(const std::string &path, LLVMContext &context, const MeasureOptions &options,
+                       ModuleResults &module, std::string &error)
+    {
+        LazyModule loaded;
+        if (!loadLazily(path, context, loaded, error))
+        {
+            return false;
+        }
+        for (Function &F : *loaded.module)
+        {
+            if (F.isDeclaration())
+            {
+                continue;
+            }
+            if (Error E = F.materialize())
+            {
+                error = path + ": " + toString(std::move(E));
+                return false;
+            }
+            uint32_t nameId = NameTable::shared().intern(path + ":" + F.getName().str());
+            module.push_back(measure(F, nameId, options));
+            if (StreamWindow != 0)
+            {
+                F.deleteBody();
+            }
+        }
+        return true;
+    }
+
+    // Many modules, each measured whole by one worker. A worker's modules all go into the
+    // worker's context, one at a time: the module and its mapping are dropped as soon as its
+    // functions are measured. Results go to the report once everything before them in input
+    // order is in, so a batch holds on to little more than the modules in flight.
+    bool measureBatch(const std::vector<std::string> &paths, unsigned threads, const MeasureOptions &options,
+                      Report &report)
+    {
+        auto start = std::chrono::steady_clock::now();
+        double cpuStart = cpuMillis();
+        std::vector<uint64_t> sizes(paths.size(), 0);
+        for (size_t index = 0; index < paths.size(); index++)
+        {
+            sys::fs::file_size(paths[index], sizes[index]);
+        }
+        std::vector<unsigned> order = biggestFirst(sizes);
+
+        WorkStealingPool pool(threads);
+        std::vector<std::unique_ptr<LLVMContext>> contexts;
+        for (unsigned worker = 0; worker < pool.size(); worker++)
+        {
+            contexts.emplace_back(new LLVMContext());
+        }
+        ShardedResults<ModuleResults> results(pool.size());
+        std::atomic<size_t> numFunctions(0);
+        std::atomic<size_t> numFailed(0);
+        auto consume = [&](unsigned, const ModuleResults &module)
+        {
+            for (const FunctionResult &result : module)
+            {
+                report.add(result);
+            }
+        };
+        pool.run(order.size(), [&](unsigned worker, size_t task)
+        {
+            unsigned index = order[task];
+            const std::string &path = paths[index];
+            ModuleResults module;
+            std::string error;
+            if (!measureLazily(path, *contexts[worker], options, module, error))
+            {
+                errs() << error << "\n";
+                module.clear();
+                numFailed++;
+            }
+            numFunctions += module.size();
+            results.add(index, std::move(module));
+            results.drainReady(consume);
+        });
+        results.drainAll(consume);
+        double wallMillis = millisSince(start);
+        double cpuMillisUsed = cpuMillis() - cpuStart;
+
+        errs() << paths.size() - numFailed << " of " << paths.size() << " modules, " << numFunctions.load()
+               << " functions on " << pool.size() << " threads in " << format("%.1f", wallMillis) << " ms wall, "
+               << format("%.1f", cpuMillisUsed) << " ms CPU, "
+               << format("%.1f", paths.size() / (wallMillis / 1000)) << " modules/s, "
+               << format("%.0f", numFunctions.load() / (wallMillis / 1000)) << " functions/s, "
+               << pool.numSteals() << " steals\n";
+        return numFailed == 0;
+    }
+
+    // a function of the patched module that has to be analyzed, and what it came to
+    struct DeltaEntry
+    {
+        // null when the function is new
+        Function *base;
+        Function *patched;
+        uint64_t hash;
+        std::vector<int> before;
+        std::vector<int> after;
+    };
+
+    bool materializeAndHash(Function &F, const std::string &path, uint64_t &hash)
+    {
+        if (Error E = F.materialize())
+        {
+            errs() << path << ": " << toString(std::move(E)) << "\n";
+            return false;
+        }
+        hash = structuralHash(F);
+        return true;
+    }
+
+    // {"added":[{"function":..,"<CountName>":value,..}],"changed":[{"function":..,"<CountName>":[before,after],..}],
+    //  "removed":[..],"renamed":[{"from":..,"to":..}],"unchanged":N} on one line, changed only
+    // listing the metrics that moved. The changed functions are printed as well, one a line.
+    bool writeDelta(const std::vector<MetricInfo> &metrics, const std::vector<bool> &selected,
+                    const std::vector<DeltaEntry> &entries, const std::vector<std::string> &removed,
+                    const std::vector<std::pair<std::string, std::string>> &renamed, size_t unchanged)
+    {
+        if (sys::fs::create_directories(ResultsDir))
+        {
+            errs() << "cannot create " << ResultsDir << "\n";
+            return false;
+        }
+        SmallString<128> path(ResultsDir);
+        sys::path::append(path, "Delta.json");
+        std::error_code EC;
+        raw_fd_ostream o(path, EC, sys::fs::F_Text);
+        if (EC)
+        {
+            errs() << path << ": " << EC.message() << "\n";
+            return false;
+        }
+        JsonStreamWriter writer(o);
+        writer.beginObject();
+        writer.key("added");
+        writer.beginArray();
+        for (const DeltaEntry &entry : entries)
+        {
+            if (entry.base != nullptr)
+            {
+                continue;
+            }
+            writer.beginObject();
+            writer.field("function", entry.patched->getName());
+            for (size_t index = 0; index < metrics.size(); index++)
+            {
+                if (selected[index])
+                {
+                    writer.field(metrics[index].countName, entry.after[index]);
+                }
+            }
+            writer.endObject();
+        }
+        writer.endArray();
+        writer.key("changed");
+        writer.beginArray();
+        for (const DeltaEntry &entry : entries)
+        {
+            if (entry.base == nullptr)
+            {
+                continue;
+            }
+            writer.beginObject();
+            writer.field("function", entry.patched->getName());
+            errs() << entry.patched->getName() << ":";
+            const char *separator = " ";
+            for (size_t index = 0; index < metrics.size(); index++)
+            {
+                if (selected[index] && entry.before[index] != entry.after[index])
+                {
+                    writer.key(metrics[index].countName);
+                    writer.beginArray();
+                    writer.value(entry.before[index]);
+                    writer.value(entry.after[index]);
+                    writer.endArray();
+                    errs() << separator << metrics[index].countName << " " << entry.before[index] << " -> "
+                           << entry.after[index];
+                    separator = ", ";
+                }
+            }
+            errs() << (*separator == ' ' ? " no metric moved\n" : "\n");
+            writer.endObject();
+        }
+        writer.endArray();
+        writer.key("removed");
+        writer.beginArray();
+        for (const std::string &name : removed)
+        {
+            writer.value(StringRef(name));
+        }
+        writer.endArray();
+        writer.key("renamed");
+        writer.beginArray();
+        for (const std::pair<std::string, std::string> &names : renamed)
+        {
+            writer.beginObject();
+            writer.field("from", StringRef(names.first));
+            writer.field("to", StringRef(names.second));
+            writer.endObject();
+        }
+        writer.endArray();
+        writer.field("unchanged", static_cast<uint64_t>(unchanged));
+        writer.endObject();
+        o << "\n";
+        return true;
+    }
+
+    // Two builds of a module. Every body is read and hashed once, and a body whose namesake
+    // in the other build hashes the same is freed on the spot, so only the changed functions
+    // stay in memory and go to the pool. A new function that hashes like a base function
+    // that is gone counts as renamed and is not analyzed either.
+    bool measureDelta(const std::string &basePath, const std::string &path, unsigned threads,
+                      const MeasureOptions &options, const std::vector<MetricInfo> &metrics)
+    {
+        auto start = std::chrono::steady_clock::now();
+        LLVMContext baseContext;
+        LLVMContext context;
+        LazyModule base;
+        LazyModule patched;
+        std::string error;
+        if (!loadLazily(basePath, baseContext, base, error) || !loadLazily(path, context, patched, error))
+        {
+            errs() << error << "\n";
+            return false;
+        }
+
+        std::vector<DeltaEntry> entries;
+        StringSet<> paired;
+        size_t unchanged = 0;
+        size_t numHashed = 0;
+        for (Function &F : *patched.module)
+        {
+            if (F.isDeclaration())
+            {
+                continue;
+            }
+            DeltaEntry entry = {nullptr, &F, 0, {}, {}};
+            if (!materializeAndHash(F, path, entry.hash))
+            {
+                return false;
+            }
+            numHashed++;
+            Function *old = base.module->getFunction(F.getName());
+            if (old != nullptr && !old->isDeclaration())
+            {
+                paired.insert(F.getName());
+                uint64_t oldHash;
+                if (!materializeAndHash(*old, basePath, oldHash))
+                {
+                    return false;
+                }
+                numHashed++;
+                if (oldHash == entry.hash)
+                {
+                    unchanged++;
+                    old->deleteBody();
+                    F.deleteBody();
+                    continue;
+                }
+                entry.base = old;
+            }
+            entries.push_back(entry);
+        }
+
+        // the base functions with no namesake left, by hash
+        std::unordered_multimap<uint64_t, std::string> gone;
+        std::vector<std::string> removed;
+        for (Function &F : *base.module)
+        {
+            if (F.isDeclaration() || paired.count(F.getName()))
+            {
+                continue;
+            }
+            uint64_t hash;
+            if (!materializeAndHash(F, basePath, hash))
+            {
+                return false;
+            }
+            numHashed++;
+            F.deleteBody();
+            gone.emplace(hash, F.getName().str());
+            removed.push_back(F.getName().str());
+        }
+        std::vector<std::pair<std::string, std::string>> renamed;
+        StringSet<> claimed;
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [&](DeltaEntry &entry)
+        {
+            if (entry.base != nullptr)
+            {
+                return false;
+            }
+            auto candidates = gone.equal_range(entry.hash);
+            for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+            {
+                if (claimed.insert(candidate->second).second)
+                {
+                    renamed.emplace_back(candidate->second, entry.patched->getName().str());
+                    entry.patched->deleteBody();
+                    return true;
+                }
+            }
+            return false;
+        }), entries.end());
+        removed.erase(std::remove_if(removed.begin(), removed.end(), [&](const std::string &name)
+        {
+            return claimed.count(name) != 0;
+        }), removed.end());
+        double matchMillis = millisSince(start);
+
+        // both sides of a changed function are tasks of their own
+        std::vector<std::pair<size_t, bool>> tasks;
+        std::vector<uint64_t> weights;
+        for (size_t index = 0; index < entries.size(); index++)
+        {
+            tasks.emplace_back(index, false);
+            weights.push_back(weightOf(*entries[index].patched));
+            if (entries[index].base != nullptr)
+            {
+                tasks.emplace_back(index, true);
+                weights.push_back(weightOf(*entries[index].base));
+            }
+        }
+        std::vector<unsigned> order = biggestFirst(weights);
+        auto analysisStart = std::chrono::steady_clock::now();
+        WorkStealingPool pool(threads);
+        pool.run(order.size(), [&](unsigned, size_t task)
+        {
+            DeltaEntry &entry = entries[tasks[order[task]].first];
+            bool before = tasks[order[task]].second;
+            Function &F = before ? *entry.base : *entry.patched;
+            FunctionResult result = measure(F, NameTable::shared().intern(F.getName()), options);
+            (before ? entry.before : entry.after) = std::move(result.values);
+        });
+        double analysisMillis = millisSince(analysisStart);
+
+        size_t numChanged = std::count_if(entries.begin(), entries.end(), [](const DeltaEntry &entry)
+        {
+            return entry.base != nullptr;
+        });
+        errs() << "delta " << basePath << " -> " << path << ": " << unchanged << " unchanged, " << numChanged
+               << " changed, " << entries.size() - numChanged << " added, " << removed.size() << " removed, "
+               << renamed.size() << " renamed; " << numHashed << " bodies hashed in " << format("%.1f", matchMillis)
+               << " ms, " << tasks.size() << " analyzed on " << pool.size() << " threads in "
+               << format("%.1f", analysisMillis) << " ms\n";
+        return writeDelta(metrics, options.selected, entries, removed, renamed, unchanged);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "run the back edge metrics over bitcode files\n");
+
+    std::vector<MetricInfo> metrics;
+    DescribeMetrics describe = {metrics};
+    AllMetrics().forEach(describe);
+    std::vector<bool> selected;
+    if (!selectMetrics(metrics, selected))
+    {
+        return 1;
+    }
+    MeasureOptions options = {selected, false, nullptr, 0, 0, nullptr};
+    options.all = std::count(selected.begin(), selected.end(), true) == static_cast<long>(selected.size());
+
+    std::vector<std::string> paths;
+    if (!collectInputs(paths))
+    {
+        return 1;
+    }
+    if (paths.empty())
+    {
+        errs() << "no bitcode to measure\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    double cpuStart = cpuMillis();
+    unsigned threads = Jobs != 0 ? Jobs : std::max(1u, std::thread::hardware_concurrency());
+    std::unique_ptr<FunctionCache> cache;
+    if (!CacheDir.empty())
+    {
+        static_assert(AllMetrics::size <= FunctionCacheEntry::MaxValues, "every metric needs a slot in the cache");
+        cache.reset(new FunctionCache(CacheDir));
+        std::string error;
+        if (!cache->open(error))
+        {
+            errs() << error << "\n";
+            return 1;
+        }
+        StableHash salt;
+        salt.add(MetricsVersion);
+        salt.add(static_cast<uint64_t>(DomEngine.getValue()));
+        options.cache = cache.get();
+        options.cacheSalt = salt.get();
+        for (size_t index = 0; index < selected.size(); index++)
+        {
+            options.cacheMask |= selected[index] ? 1u << index : 0;
+        }
+    }
+    ShapeMemo memo;
+    if (DedupShapes)
+    {
+        options.memo = &memo;
+    }
+    bool ok;
+    if (!DeltaBase.empty())
+    {
+        if (paths.size() != 1)
+        {
+            errs() << "-delta-base compares one module with its base\n";
+            return 1;
+        }
+        ok = measureDelta(DeltaBase, paths.front(), threads, options, metrics);
+    }
+    else
+    {
+        Report report(metrics, selected);
+        bool batch = paths.size() > 1 || !InputList.empty() || sys::fs::is_directory(Inputs.front());
+        ok = batch ? measureBatch(paths, threads, options, report)
+           : ParallelParse ? measureModuleInParallel(paths.front(), threads, options, report)
+                           : measureModule(paths.front(), threads, options, report);
+        ok &= report.write();
+    }
+    if (DedupShapes)
+    {
+        memo.printHitRates(errs());
+    }
+    if (cache)
+    {
+        errs() << "cache " << CacheDir << ": " << cache->numHits() << " hits, " << cache->numMisses()
+               << " misses, " << cache->numAdded() << " added\n";
+        std::string error;
+        if (!cache->save(uint64_t(CacheSizeMB) << 20, error))
+        {
+            errs() << error << "\n";
+            ok = false;
+        }
+    }
+
+    errs() << "total " << format("%.1f", millisSince(start)) << " ms wall, "
+           << format("%.1f", cpuMillis() - cpuStart) << " ms CPU, peak RSS "
+           << format("%.1f", peakRSSMegabytes()) << " MB\n";
+    return ok ? 0 : 1;
+}
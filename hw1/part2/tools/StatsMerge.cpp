@@ -0,0 +1,251 @@
+/*
+ *
+ *
+ * ______
+ *|  ____|
+ *| |__ __ _ _ __ _______  _ __
+ *|  __/ _` | '__|_  / _ \| '_ \
+ *| | | (_| | |   / / (_) | | | |
+ *|_|  \__,_|_|  /___\___/|_| |_|
+ *
+ *  Created by Farzon Lotfi.
+ *  Copyright 2018 Georgia Tech. All rights reserved.
+ *
+ */
+
+// Combines the shards the passes write with -stats-shard-dir into corpus wide statistics.
+// Every thread folds a contiguous slice of the (sorted) shard list, then the partial results
+// are merged pairwise in a tree, so the output does not depend on thread timing. Count, sum,
+// min, max and mean are exact, percentiles come from the merged sketches.
+//
+//   statsmerge [-j=N] [-o=merged.shard.json] [-summary-dir=dir] shards/ a.shard.json ...
+
+#include "StatsShard.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+using namespace backedges;
+
+static cl::list<std::string> Inputs(cl::Positional, cl::desc("<shard files or directories>"), cl::OneOrMore);
+static cl::opt<unsigned> Jobs("j", cl::desc("Worker threads, 0 uses every core"), cl::init(0));
+static cl::opt<std::string> OutputShard("o", cl::desc("Write the merged accumulators as one shard"),
+                                        cl::value_desc("file"));
+static cl::opt<std::string> SummaryDir("summary-dir",
+    cl::desc("Also write <CountName>.json summaries like testResults/"), cl::value_desc("dir"));
+
+namespace
+{
+    // metrics by count name, std::map keeps the output order stable
+    typedef std::map<std::string, ShardMetric> MetricTable;
+
+    struct Partial
+    {
+        MetricTable metrics;
+        unsigned shards = 0;
+        std::vector<std::string> errors;
+    };
+
+    void mergeMetric(MetricTable &into, ShardMetric &metric)
+    {
+        auto found = into.find(metric.countName);
+        if (found == into.end())
+        {
+            std::string name = metric.countName;
+            into.insert(std::make_pair(name, std::move(metric)));
+        }
+        else
+        {
+            found->second.merge(metric);
+        }
+    }
+
+    void mergeInto(MetricTable &into, MetricTable &from)
+    {
+        for (auto &entry : from)
+        {
+            mergeMetric(into, entry.second);
+        }
+        from.clear();
+    }
+
+    void foldShards(const std::vector<std::string> &paths, size_t begin, size_t end, Partial &partial)
+    {
+        for (size_t index = begin; index < end; index++)
+        {
+            ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(paths[index]);
+            if (!buffer)
+            {
+                partial.errors.push_back(paths[index] + ": " + buffer.getError().message());
+                continue;
+            }
+            std::vector<ShardMetric> metrics;
+            std::string error;
+            if (!readShard((*buffer)->getBuffer(), metrics, error))
+            {
+                partial.errors.push_back(paths[index] + ": " + error);
+                continue;
+            }
+            for (ShardMetric &metric : metrics)
+            {
+                mergeMetric(partial.metrics, metric);
+            }
+            partial.shards++;
+        }
+    }
+
+    // directories contribute their *.shard.json files
+    bool collectInputs(std::vector<std::string> &paths)
+    {
+        for (const std::string &input : Inputs)
+        {
+            if (!sys::fs::is_directory(input))
+            {
+                paths.push_back(input);
+                continue;
+            }
+            std::error_code EC;
+            for (sys::fs::directory_iterator entry(input, EC), end; entry != end && !EC; entry.increment(EC))
+            {
+                if (StringRef(entry->path()).endswith(".shard.json"))
+                {
+                    paths.push_back(entry->path());
+                }
+            }
+            if (EC)
+            {
+                errs() << input << ": " << EC.message() << "\n";
+                return false;
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+        return true;
+    }
+
+    bool writeSummaries(const MetricTable &metrics)
+    {
+        if (sys::fs::create_directories(SummaryDir))
+        {
+            errs() << "cannot create " << SummaryDir << "\n";
+            return false;
+        }
+        for (const auto &entry : metrics)
+        {
+            SmallString<128> path(SummaryDir);
+            sys::path::append(path, entry.first + ".json");
+            std::error_code EC;
+            raw_fd_ostream o(path, EC, sys::fs::F_Text);
+            if (EC)
+            {
+                errs() << path << ": " << EC.message() << "\n";
+                return false;
+            }
+            writeResultsJson(o, entry.second.summarize(), nullptr);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "merge -stats-shard-dir shards\n");
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> paths;
+    if (!collectInputs(paths))
+    {
+        return 1;
+    }
+    if (paths.empty())
+    {
+        errs() << "no shards to merge\n";
+        return 1;
+    }
+
+    unsigned threads = Jobs != 0 ? Jobs : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, paths.size());
+    std::vector<Partial> partials(threads);
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < threads; worker++)
+    {
+        size_t begin = paths.size() * worker / threads;
+        size_t end = paths.size() * (worker + 1) / threads;
+        workers.emplace_back(foldShards, std::cref(paths), begin, end, std::ref(partials[worker]));
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    // pairwise tree over the partials, each level merges its pairs in parallel
+    for (unsigned stride = 1; stride < threads; stride *= 2)
+    {
+        workers.clear();
+        for (unsigned left = 0; left + stride < threads; left += 2 * stride)
+        {
+            workers.emplace_back([&partials, left, stride]()
+            {
+                Partial &into = partials[left];
+                Partial &from = partials[left + stride];
+                mergeInto(into.metrics, from.metrics);
+                into.shards += from.shards;
+                into.errors.insert(into.errors.end(), from.errors.begin(), from.errors.end());
+            });
+        }
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+    Partial &result = partials[0];
+    auto stop = std::chrono::steady_clock::now();
+
+    for (const std::string &error : result.errors)
+    {
+        errs() << error << "\n";
+    }
+    for (const auto &entry : result.metrics)
+    {
+        outs() << entry.second.summarize() << "\n";
+    }
+
+    bool ok = result.errors.empty();
+    if (!OutputShard.empty())
+    {
+        std::error_code EC;
+        raw_fd_ostream o(OutputShard, EC, sys::fs::F_Text);
+        if (EC)
+        {
+            errs() << OutputShard << ": " << EC.message() << "\n";
+            return 1;
+        }
+        std::vector<ShardMetric> merged;
+        for (const auto &entry : result.metrics)
+        {
+            merged.push_back(entry.second);
+        }
+        writeShard(o, merged);
+    }
+    if (!SummaryDir.empty())
+    {
+        ok &= writeSummaries(result.metrics);
+    }
+
+    errs() << "merged " << result.shards << " of " << paths.size() << " shards, " << result.metrics.size()
+           << " metrics, " << threads << " threads, "
+           << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() << " ms\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+./llvmJit.sh
+../../llvmBuild/bin/statsdriver test1.bc
+../../llvmBuild/bin/statsdriver test1.bc test2.bc test3.bc -results-dir=batchResults
+echo -e "\n\n serial opt -allstats:"
+time ../../llvmBuild/bin/opt -load ../../llvmBuild/lib/LLVMBackEdges.dylib -allstats -disable-output test1.bc
+echo -e "\n\n statsdriver -parallel-parse:"
+time ../../llvmBuild/bin/statsdriver -parallel-parse test1.bc
+echo -e "\n\n statsdriver -dedup-shapes:"
+time ../../llvmBuild/bin/statsdriver -dedup-shapes test1.bc test2.bc test3.bc -results-dir=batchResults
+echo -e "\n\n -dedup-shapes keeps layout dependent post-dominators apart (expect no diff):"
+../../llvmBuild/bin/llvm-as shapeLayout.ll -o shapeLayout.bc
+../../llvmBuild/bin/opt -load ../../llvmBuild/lib/LLVMBackEdges.dylib -controldep -stats-detail=per-function -disable-output shapeLayout.bc
+mv testResults/ControlDependence.json shapeLayout.controldep.json
+../../llvmBuild/bin/statsdriver -dedup-shapes shapeLayout.bc
+diff shapeLayout.controldep.json testResults/ControlDependence.json
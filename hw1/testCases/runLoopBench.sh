@@ -0,0 +1,3 @@
+./llvmJit.sh
+../../llvmBuild/bin/loopbench test1.bc test2.bc test3.bc > loopbench.csv
+../../llvmBuild/bin/loopbench test1.bc test2.bc test3.bc -format=json > loopbench.json 2>/dev/null
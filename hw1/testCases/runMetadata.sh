@@ -0,0 +1,5 @@
+./llvmJit.sh
+echo -e "\n\n allstats, attaching !backedges.metrics:"
+time ../../llvmBuild/bin/opt -load ../../llvmBuild/lib/LLVMBackEdges.dylib -allstats -stats-metadata test1.bc -o test1.metrics.bc
+echo -e "\n\n allstats again, from the metadata:"
+time ../../llvmBuild/bin/opt -load ../../llvmBuild/lib/LLVMBackEdges.dylib -allstats -stats-metadata test1.metrics.bc -disable-output
@@ -0,0 +1,31 @@
+; two functions with the same CFG laid out in a different order. spin never reaches the
+; return, so PostDominatorTree picks its root by layout and ControlDependence differs
+define void @first(i1 %c) {
+entry:
+  br i1 %c, label %loop, label %spin
+loop:
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+spin:
+  br label %spin2
+spin2:
+  br i1 %c, label %spin, label %spin3
+spin3:
+  br label %spin
+}
+
+define void @second(i1 %c) {
+entry:
+  br i1 %c, label %loop, label %spin
+spin3:
+  br label %spin
+spin2:
+  br i1 %c, label %spin, label %spin3
+spin:
+  br label %spin2
+exit:
+  ret void
+loop:
+  br i1 %c, label %loop, label %exit
+}
@@ -21,6 +21,9 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
 
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/DebugInfoMetadata.h"
@@ -28,6 +31,7 @@
 
 #include <set>
 #include <stack>
+#include <vector>
 #include  <utility> //std::pair
 #include <algorithm>    // std::set_difference
 
@@ -35,6 +39,71 @@ using namespace llvm;
 
 namespace
 {
+    // a load from a variable no store before it in the function wrote to
+    struct UninitializedLoad
+    {
+        StringRef variable;
+        bool hasLine;
+        unsigned line;
+    };
+    
+    //An iterator over a Function gives us a list of basic blocks.
+    std::vector<UninitializedLoad> findUninitializedLoads(const Function& func)
+    {
+        std::vector<UninitializedLoad> loads;
+        std::set<StringRef> stored;
+        for (Function::const_iterator iter = func.begin(); iter != func.end(); ++iter) {
+            const BasicBlock &currBlock = *iter;
+            const BasicBlock::InstListType* instList =  &currBlock.getInstList();
+
+            for(BasicBlock::InstListType::const_iterator instrIter = instList->begin(); 
+            instrIter != instList->end(); ++instrIter) {
+                const Instruction &currInst = *instrIter;
+                
+                if(isa<StoreInst>(currInst)) {
+                    auto op = currInst.getOperand(1);
+                    stored.insert(op->getName());
+                }
+                
+                if(isa<LoadInst>(currInst)) {
+                    auto op = currInst.getOperand(0);
+                    bool bNotInit = (stored.find(op->getName()) == stored.end());
+                    if(bNotInit) {
+                        UninitializedLoad load = {op->getName(), false, 0};
+                        const DebugLoc &DL = currInst.getDebugLoc();
+                        if(DL) {
+                            load.hasLine = true;
+                            load.line = DL.getLine();
+                        }
+                        else
+                        {
+                            if(const MDNode *md = currInst.getMetadata("dbg")) {
+                                if(auto *subProgram = dyn_cast<DISubprogram>(md)) {
+                                    load.hasLine = true;
+                                    load.line = subProgram->getLine();
+                                }
+                            }
+                        }
+                        loads.push_back(load);
+                    }
+                }
+            }
+        }
+        return loads;
+    }
+    
+    void printUninitializedLoads(const Function& func, const std::vector<UninitializedLoad> &loads)
+    {
+        errs() << "function: " << func.getName() << "\n";
+        for (const UninitializedLoad &load : loads) {
+            errs() << "unitialized variable: " << load.variable;
+            if(load.hasLine) {
+                errs() << " used on line: " << load.line;
+            }
+            errs() << " found.\n";
+        }
+    }
+    
     //2.1 Average, maximum and minimum number of basic blocks inside functions.
     struct UninitializedVar : public FunctionPass
     {
@@ -43,61 +112,9 @@ namespace
         virtual ~UninitializedVar() {}
         bool runOnFunction(Function &F) override
         {
-            getUninitializedVarInfo(F);
+            printUninitializedLoads(F, findUninitializedLoads(F));
             return false;
         }
-        
-        //An iterator over a Function gives us a list of basic blocks.
-        void getUninitializedVarInfo(const Function& func) const
-        {
-            std::set<StringRef> stored;
-            errs() << "function: " << func.getName() << "\n";
-            for (Function::const_iterator iter = func.begin(); iter != func.end(); ++iter) {
-                const BasicBlock &currBlock = *iter;
-                const BasicBlock::InstListType* instList =  &currBlock.getInstList();
-
-                for(BasicBlock::InstListType::const_iterator instrIter = instList->begin(); 
-                instrIter != instList->end(); ++instrIter) {
-                    const Instruction &currInst = *instrIter;
-                    
-                    if(isa<StoreInst>(currInst)) {
-                        //errs() << "store instruction found: [ ";
-                        //for (auto op = currInst.op_begin(); op != currInst.op_end(); op++) {
-                        //    errs() << (*op)->getName() << " ";
-                        //}
-                        //errs() << "]\n";
-                        auto op = currInst.getOperand(1);
-                        stored.insert(op->getName());
-                    }
-                    
-                    if(isa<LoadInst>(currInst)) {
-                        auto op = currInst.getOperand(0);
-                        bool bNotInit = (stored.find(op->getName()) == stored.end());
-                        if(bNotInit) {
-                            errs() << "unitialized variable: " << op->getName();
-                            const DebugLoc &DL = currInst.getDebugLoc();
-                            if(DL) {
-                                errs() << " used on line: " << DL.getLine();
-                            }
-                            else
-                            {
-                                if(const MDNode *md = currInst.getMetadata("dbg")) {
-                                    if(auto *subProgram = dyn_cast<DISubprogram>(md)) {
-                                        errs() << " used on line: " << subProgram->getLine();
-                                    }
-                                }
-                            }
-                            errs() << " found.\n";
-                        }
-                        //errs() << "load instruction found " << (bNotInit ? "not" : "") << " initalized : [ ";
-                        //for (auto op = currInst.op_begin(); op != currInst.op_end(); op++) {
-                        //    errs() << (*op)->getName() << " ";
-                        //}
-                        //errs() << "]\n";
-                    }
-                }
-            }
-        }
 
         bool doFinalization(Module &M) override {
             return false;
@@ -126,7 +143,7 @@ namespace
             return false;
         }
         
-        void printList(std::vector<const BasicBlock *> &list)
+        static void printList(std::vector<const BasicBlock *> &list)
         {
             if(list.empty())
             {
@@ -144,7 +161,7 @@ namespace
             errs() << "]\n";
         }
         
-        void reachable(Function &func)
+        static void reachable(Function &func)
         {
             errs() << "Start reachable analysis on "<< func.getName() << ":\n";
             int nReachable = 0;
@@ -218,7 +235,7 @@ namespace
          9                  S.push(w)
          */
         
-        std::vector<const BasicBlock*> dfs(const BasicBlock* A, const BasicBlock* B, int &reachable)
+        static std::vector<const BasicBlock*> dfs(const BasicBlock* A, const BasicBlock* B, int &reachable)
         {
             std::stack<std::pair<const BasicBlock*,std::vector<const BasicBlock*>>> s;
             std::set<const BasicBlock*> visited;
@@ -263,3 +280,74 @@ char ReachablePass::ID = 0;
 static RegisterPass<ReachablePass>
 Y("runinit", "reachable uninit");
 
+
+// The new pass manager's side of the plugin: the uninitialized loads are a cached function
+// analysis, the passes print them.
+namespace
+{
+    class UninitializedLoadsAnalysis : public AnalysisInfoMixin<UninitializedLoadsAnalysis>
+    {
+    public:
+        typedef std::vector<UninitializedLoad> Result;
+        
+        Result run(Function &F, FunctionAnalysisManager &FAM)
+        {
+            return findUninitializedLoads(F);
+        }
+        
+    private:
+        friend AnalysisInfoMixin<UninitializedLoadsAnalysis>;
+        static AnalysisKey Key;
+    };
+    
+    AnalysisKey UninitializedLoadsAnalysis::Key;
+    
+    // -passes=nuninit
+    struct UninitializedVarPrinter : public PassInfoMixin<UninitializedVarPrinter>
+    {
+        PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM)
+        {
+            printUninitializedLoads(F, FAM.getResult<UninitializedLoadsAnalysis>(F));
+            return PreservedAnalyses::all();
+        }
+    };
+    
+    // -passes=runinit
+    struct ReachableUninitPrinter : public PassInfoMixin<ReachableUninitPrinter>
+    {
+        PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM)
+        {
+            ReachablePass::reachable(F);
+            return PreservedAnalyses::all();
+        }
+    };
+    
+    void registerCallbacks(PassBuilder &PB)
+    {
+        PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM)
+        {
+            FAM.registerPass([]() { return UninitializedLoadsAnalysis(); });
+        });
+        PB.registerPipelineParsingCallback([](StringRef name, FunctionPassManager &FPM,
+                                              ArrayRef<PassBuilder::PipelineElement>)
+        {
+            if (name == "nuninit")
+            {
+                FPM.addPass(UninitializedVarPrinter());
+                return true;
+            }
+            if (name == "runinit")
+            {
+                FPM.addPass(ReachableUninitPrinter());
+                return true;
+            }
+            return false;
+        });
+    }
+}
+
+// opt -load-pass-plugin=uninitVars.so -passes=nuninit
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo()
+{
+    return {LLVM_PLUGIN_API_VERSION, "uninitVars", LLVM_VERSION_STRING, registerCallbacks};
+}